@@ -49,34 +49,69 @@ email: m-mat @ math.sci.hiroshima-u.ac.jp (remove space)"
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+#include "AES_5RoundDistinguisher.h"
 
 #define N_Round 5
+#ifndef N_TEST
 #define N_TEST 4100
+#endif
+#define N_CANDIDATES 65536 /* values of (k1, k2, k3, k4) */
 
 //random
-#define N 624
-#define M 397
+#define MT_N 624
+#define MT_M 397
 #define MATRIX_A 0x9908b0dfUL   /* constant vector a */
 #define UPPER_MASK 0x80000000UL /* most significant w-r bits */
 #define LOWER_MASK 0x7fffffffUL /* least significant r bits */
 
-typedef unsigned char word8;//8 bits
+//the state and the functions of the engine are in the namespace aes5: only the library interface (aes5*) and main are outside
+namespace aes5 {
 
-//S-box
-const unsigned char sBox[16] = {
+typedef aes5Word8 word8;//8 bits
+typedef unsigned long long word64;//64 bits
+
+//S-box (see loadSPNVariant)
+unsigned char sBox[16] = {
 	0x6, 0xB, 0x5, 0x4, 0x2, 0xE, 0x7, 0xA, 0x9, 0xD, 0xF, 0xC, 0x3, 0x1, 0x0, 0x8
 };
 
-//Inverse S-box
-const unsigned char inv_s[16] = {
+//Inverse S-box (computed from sBox by initializationSPN)
+unsigned char inv_s[16] = {
 	0xE, 0xD, 0x4, 0xC, 0x3, 0x2, 0x0, 0x6, 0xF, 0x8, 0x7, 0x1, 0xB, 0x9, 0x5, 0xA
 };
 
 word8 play[16][16], cipher[16][16];
-word8 constants[N_TEST][12];/*To store the 12 nibbles of N_TEST column*/
+long int testBudget = N_TEST;/* tests for each candidate of the pipeline (at most N_TEST): aes5Run sets it for its run and restores it */
 
-static unsigned long mt[N]; /* the array for the state vector  */
-static int mti = N + 1; /* mti==N+1 means mt[N] is not initialized */
+static unsigned long mt[MT_N]; /* the array for the state vector  */
+static int mti = MT_N + 1; /* mti==MT_N+1 means mt[MT_N] is not initialized */
 
 
 /**Several ways to generate random number*/
@@ -107,11 +142,11 @@ int randomInRange2(int min, int max){
 
 }
 
-/* initializes mt[N] with a seed */
+/* initializes mt[MT_N] with a seed */
 void init_genrand(unsigned long s)
 {
 	mt[0] = s & 0xffffffffUL;
-	for (mti = 1; mti<N; mti++)
+	for (mti = 1; mti<MT_N; mti++)
 	{
 		mt[mti] =
 			(1812433253UL * (mt[mti - 1] ^ (mt[mti - 1] >> 30)) + mti);
@@ -127,22 +162,22 @@ void init_by_array(unsigned long init_key[], int key_length)
 	int i, j, k;
 	init_genrand(19650218UL);
 	i = 1; j = 0;
-	k = (N>key_length ? N : key_length);
+	k = (MT_N>key_length ? MT_N : key_length);
 	for (; k; k--)
 	{
 		mt[i] = (mt[i] ^ ((mt[i - 1] ^ (mt[i - 1] >> 30)) * 1664525UL))
 			+ init_key[j] + j; /* non linear */
 		mt[i] &= 0xffffffffUL; /* for WORDSIZE > 32 machines */
 		i++; j++;
-		if (i >= N) { mt[0] = mt[N - 1]; i = 1; }
+		if (i >= MT_N) { mt[0] = mt[MT_N - 1]; i = 1; }
 		if (j >= key_length) j = 0;
 	}
-	for (k = N - 1; k; k--) {
+	for (k = MT_N - 1; k; k--) {
 		mt[i] = (mt[i] ^ ((mt[i - 1] ^ (mt[i - 1] >> 30)) * 1566083941UL))
 			- i; /* non linear */
 		mt[i] &= 0xffffffffUL; /* for WORDSIZE > 32 machines */
 		i++;
-		if (i >= N) { mt[0] = mt[N - 1]; i = 1; }
+		if (i >= MT_N) { mt[0] = mt[MT_N - 1]; i = 1; }
 	}
 
 	mt[0] = 0x80000000UL; /* MSB is 1; assuring non-zero initial array */
@@ -155,24 +190,24 @@ unsigned long genrand_int32(void)
 	static unsigned long mag01[2] = { 0x0UL, MATRIX_A };
 	/* mag01[x] = x * MATRIX_A  for x=0,1 */
 
-	if (mti >= N) { /* generate N words at one time */
+	if (mti >= MT_N) { /* generate MT_N words at one time */
 		int kk;
 
-		if (mti == N + 1)   /* if init_genrand() has not been called, */
+		if (mti == MT_N + 1)   /* if init_genrand() has not been called, */
 			init_genrand(5489UL); /* a default initial seed is used */
 
-		for (kk = 0; kk<N - M; kk++)
+		for (kk = 0; kk<MT_N - MT_M; kk++)
 		{
 			y = (mt[kk] & UPPER_MASK) | (mt[kk + 1] & LOWER_MASK);
-			mt[kk] = mt[kk + M] ^ (y >> 1) ^ mag01[y & 0x1UL];
+			mt[kk] = mt[kk + MT_M] ^ (y >> 1) ^ mag01[y & 0x1UL];
 		}
-		for (; kk<N - 1; kk++)
+		for (; kk<MT_N - 1; kk++)
 		{
 			y = (mt[kk] & UPPER_MASK) | (mt[kk + 1] & LOWER_MASK);
-			mt[kk] = mt[kk + (M - N)] ^ (y >> 1) ^ mag01[y & 0x1UL];
+			mt[kk] = mt[kk + (MT_M - MT_N)] ^ (y >> 1) ^ mag01[y & 0x1UL];
 		}
-		y = (mt[N - 1] & UPPER_MASK) | (mt[0] & LOWER_MASK);
-		mt[N - 1] = mt[M - 1] ^ (y >> 1) ^ mag01[y & 0x1UL];
+		y = (mt[MT_N - 1] & UPPER_MASK) | (mt[0] & LOWER_MASK);
+		mt[MT_N - 1] = mt[MT_M - 1] ^ (y >> 1) ^ mag01[y & 0x1UL];
 
 		mti = 0;
 	}
@@ -206,6 +241,83 @@ word8 randomByte(){
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+/**TEST CONSTANTS:
+the 12 constants of the test k (the cells out of the active diagonal, the same for all the candidates) are not stored: they are a
+function of (constantSeed, k), so they take no memory for any N_TEST, and any test can be read without the ones before it.
+The stream is counter-based: the word w of the test k is the finalizer of SplitMix64 on constantSeed + (2k + w) * golden ratio, and
+the cells are packed in it - 12 nibbles in the 48 bits of the word 0, or 12 bytes in the word 0 and in the 32 bits of the word 1.
+Each thread reads the stream through its own chunk of CONSTANT_CHUNK tests (constantChunk, generated at once when a test falls out
+of it): the candidates read the tests in order, so a chunk is generated once for each CONSTANT_CHUNK tests.
+constantSeed is drawn from the random generator (newConstants, generateConstants): the same seed gives the same constants.
+*/
+
+#define CONSTANT_CHUNK 256 /* must be a power of 2 */
+
+word64 constantSeed = 0;
+int constantBits = 4;/* bits of a cell of the constants */
+unsigned long constantVersion = 0;/* incremented by newConstants: a chunk of another version is generated again */
+
+typedef struct{
+	unsigned long version;
+	long int first;
+	word64 packed[CONSTANT_CHUNK][2];
+} constantChunk;
+
+inline word64 constantWord(word64 counter){
+
+	word64 z = constantSeed + counter * 0x9E3779B97F4A7C15ULL;
+
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+
+	return z ^ (z >> 31);
+}
+
+/*New constants for cells of bits bits*/
+
+void newConstants(int bits){
+
+	constantSeed = ((word64)genrand_int32() << 32) | (word64)genrand_int32();
+	constantBits = bits;
+	constantVersion++;
+}
+
+/*The 12 cells of the test k*/
+
+void testConstants(long int k, word8 *cells){
+
+	static thread_local constantChunk chunk = { 0, 0, { { 0 } } };
+	int i;
+	word64 *packed;
+
+	if ((chunk.version != constantVersion) || (k < chunk.first) || (k >= chunk.first + CONSTANT_CHUNK))
+	{
+		chunk.version = constantVersion;
+		chunk.first = k & ~((long int)CONSTANT_CHUNK - 1);
+		for (i = 0; i < CONSTANT_CHUNK; i++)
+		{
+			chunk.packed[i][0] = constantWord(2 * (word64)(chunk.first + i));
+			chunk.packed[i][1] = constantWord(2 * (word64)(chunk.first + i) + 1);
+		}
+	}
+
+	packed = chunk.packed[k - chunk.first];
+	if (constantBits == 4)
+	{
+		for (i = 0; i < 12; i++)
+			cells[i] = (word8)((packed[0] >> (4 * i)) & 0xf);
+	}
+	else
+	{
+		for (i = 0; i < 8; i++)
+			cells[i] = (word8)((packed[0] >> (8 * i)) & 0xff);
+		for (i = 8; i < 12; i++)
+			cells[i] = (word8)((packed[1] >> (8 * (i - 8))) & 0xff);
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 /*Multiplication*/
 
 word8 multiplicationX(word8 byte){
@@ -235,6 +347,22 @@ word8 multiplicationXN(word8 byte, int n){
 
 }
 
+/*Multiplication a times b*/
+
+word8 multiplication(word8 a, word8 b){
+
+	int i;
+	word8 result = 0;
+
+	for (i = 0; i<4; i++){
+		if ((b >> i) & 0x1)
+			result ^= multiplicationXN(a, i);
+	}
+
+	return result;
+
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 /*Initialization State*/
@@ -265,38 +393,221 @@ void initialization2(word8 *p, unsigned char initialMessage[][4]){
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-/*Partial inverse mixcolumn - only on the first column*/
+/**S-BOX AND LINEAR LAYER:
+the S-box (sBox) and the matrix of MixColumns (mixMatrix - by default the circulant matrix (x, x+1, 1, 1)) can be replaced at startup
+by loadSPNVariant. Then initializationSPN checks that they are invertible, computes inv_s and the inverse matrix, and generates the
+tables used by mixColumn, partialInvMixColumn, inverseMixColumn, encryptionFused and decryptionFused.
+A column is packed in 16 bits (row i in the bits 4i - 4i+3):
+- mixTable[r][v]: MixColumns of the column with v in the row r and 0 elsewhere;
+- invMixTable[r][v]: the same with the inverse matrix;
+- sBoxMixTable[r][v] = mixTable[r][sBox[v]] (byte sub transformation and mixcolumn together);
+- invSBoxMixTable[r][v] = invMixTable[r][inv_s[v]] (inverse S-box and inverse mixcolumn together).
+*/
 
-void partialInvMixColumn(word8 *p){
+word8 mixMatrix[4][4] = {
+	0x2, 0x3, 0x1, 0x1,
+	0x1, 0x2, 0x3, 0x1,
+	0x1, 0x1, 0x2, 0x3,
+	0x3, 0x1, 0x1, 0x2
+};
 
-	int j;
-	word8 colonna[4], nuovaColonna[4];
+word8 invMixMatrix[4][4];
+unsigned short mixTable[4][16], invMixTable[4][16], sBoxMixTable[4][16], invSBoxMixTable[4][16];
 
-	//prendo la colonna i-sima
-	for (j = 0; j<4; j++){
-		colonna[j] = *(p + j);
+/*Inverse of a n x n matrix (Gauss-Jordan) - it returns 0 if the matrix is singular, 1 otherwise*/
+
+int inverseMatrix(word8 matrix[][4], word8 inverse[][4], int n){
+
+	int i, j, l, pivot;
+	word8 a[4][8], temp, factor;
+
+	for (i = 0; i < n; i++){
+		for (j = 0; j < n; j++){
+			a[i][j] = matrix[i][j];
+			a[i][j + n] = (i == j) ? 0x1 : 0x0;
+		}
 	}
 
-	//calcolo nuova colonna
-	nuovaColonna[0] = multiplicationXN(colonna[0], 3) ^ multiplicationXN(colonna[0], 2) ^ multiplicationX(colonna[0]) ^
-		multiplicationXN(colonna[1], 3) ^ multiplicationX(colonna[1]) ^ colonna[1] ^ multiplicationXN(colonna[2], 3) ^
-		multiplicationXN(colonna[2], 2) ^ colonna[2] ^ multiplicationXN(colonna[3], 3) ^ colonna[3];
+	for (i = 0; i < n; i++){
+
+		//pivot
+		for (pivot = i; (pivot < n) && (a[pivot][i] == 0); pivot++);
+		if (pivot == n)
+			return 0;
+
+		for (j = 0; j < 2 * n; j++){
+			temp = a[i][j];
+			a[i][j] = a[pivot][j];
+			a[pivot][j] = temp;
+		}
+
+		//normalization of the row i
+		for (factor = 1; multiplication(a[i][i], factor) != 1; factor++);
+		for (j = 0; j < 2 * n; j++)
+			a[i][j] = multiplication(a[i][j], factor);
+
+		//elimination
+		for (l = 0; l < n; l++){
+			if ((l != i) && (a[l][i] != 0)){
+				factor = a[l][i];
+				for (j = 0; j < 2 * n; j++)
+					a[l][j] ^= multiplication(factor, a[i][j]);
+			}
+		}
+	}
+
+	for (i = 0; i < n; i++){
+		for (j = 0; j < n; j++)
+			inverse[i][j] = a[i][j + n];
+	}
 
-	nuovaColonna[1] = multiplicationXN(colonna[0], 3) ^ colonna[0] ^ multiplicationXN(colonna[1], 3) ^ multiplicationXN(colonna[1], 2) ^
-		multiplicationX(colonna[1]) ^ multiplicationXN(colonna[2], 3) ^ multiplicationX(colonna[2]) ^ colonna[2] ^
-		multiplicationXN(colonna[3], 3) ^ multiplicationXN(colonna[3], 2) ^ colonna[3];
+	return 1;
+}
+
+/*MDS: all the square submatrices are invertible (branch number 5)*/
+
+int isMDS(word8 matrix[][4]){
+
+	int rows, columns, i, j, n, m;
+	word8 sub[4][4], inverse[4][4];
+
+	for (rows = 1; rows < 16; rows++){
+		for (columns = 1; columns < 16; columns++){
+
+			if (__builtin_popcount(rows) != __builtin_popcount(columns))
+				continue;
+
+			n = 0;
+			for (i = 0; i < 4; i++){
+				if (((rows >> i) & 0x1) == 0)
+					continue;
+				m = 0;
+				for (j = 0; j < 4; j++){
+					if ((columns >> j) & 0x1)
+						sub[n][m++] = matrix[i][j];
+				}
+				n++;
+			}
+
+			if (inverseMatrix(sub, inverse, n) == 0)
+				return 0;
+		}
+	}
+
+	return 1;
+}
+
+/*It returns 1 if the S-box or the matrix is not invertible, 0 otherwise*/
+
+int initializationSPN(){
+
+	int i, r, v;
+	unsigned short colonna;
+
+	for (v = 0; v < 16; v++)
+		inv_s[v] = 0x10;
+	for (v = 0; v < 16; v++){
+		if (inv_s[sBox[v] & 0xf] != 0x10){
+			printf("The S-box is not a permutation.\n");
+			return 1;
+		}
+		inv_s[sBox[v] & 0xf] = (word8)v;
+	}
+
+	if (inverseMatrix(mixMatrix, invMixMatrix, 4) == 0){
+		printf("The matrix is not invertible.\n");
+		return 1;
+	}
+
+	if (isMDS(mixMatrix) == 0)
+		printf("Warning: the matrix is not MDS.\n");
+
+	for (r = 0; r < 4; r++){
+		for (v = 0; v < 16; v++){
+
+			colonna = 0;
+			for (i = 0; i < 4; i++)
+				colonna |= (unsigned short)(multiplication(mixMatrix[i][r], (word8)v) << (4 * i));
+			mixTable[r][v] = colonna;
+
+			colonna = 0;
+			for (i = 0; i < 4; i++)
+				colonna |= (unsigned short)(multiplication(invMixMatrix[i][r], (word8)v) << (4 * i));
+			invMixTable[r][v] = colonna;
+		}
+	}
+
+	for (r = 0; r < 4; r++){
+		for (v = 0; v < 16; v++){
+			sBoxMixTable[r][v] = mixTable[r][sBox[v]];
+			invSBoxMixTable[r][v] = invMixTable[r][inv_s[v]];
+		}
+	}
 
-	nuovaColonna[2] = multiplicationXN(colonna[0], 3) ^ multiplicationXN(colonna[0], 2) ^ colonna[0] ^ multiplicationXN(colonna[1], 3) ^
-		colonna[1] ^ multiplicationXN(colonna[2], 3) ^ multiplicationXN(colonna[2], 2) ^ multiplicationX(colonna[2]) ^
-		multiplicationXN(colonna[3], 3) ^ multiplicationX(colonna[3]) ^ colonna[3];
+	return 0;
+}
+
+/*File of an SPN variant (hexadecimal values separated by spaces):
+the 16 values of the S-box, then the 16 entries of the matrix (row by row) or only the first row of a circulant matrix.
+It returns 1 if the file is not valid, 0 otherwise*/
+
+int loadSPNVariant(const char *fileName){
+
+	FILE *fp;
+	unsigned int value[32];
+	int i, j, n;
+
+	fp = fopen(fileName, "r");
+	if (fp == NULL){
+		printf("Cannot open %s.\n", fileName);
+		return 1;
+	}
+
+	for (n = 0; (n < 32) && (fscanf(fp, "%x", &(value[n])) == 1); n++);
+	fclose(fp);
+
+	if ((n != 20) && (n != 32)){
+		printf("%s: expected 16 values of the S-box and 4 (circulant) or 16 entries of the matrix.\n", fileName);
+		return 1;
+	}
+
+	for (i = 0; i < n; i++){
+		if (value[i] > 0xf){
+			printf("%s: 0x%x is not a nibble.\n", fileName, value[i]);
+			return 1;
+		}
+	}
 
-	nuovaColonna[3] = multiplicationXN(colonna[0], 3) ^ multiplicationX(colonna[0]) ^ colonna[0] ^ multiplicationXN(colonna[1], 3) ^
-		multiplicationXN(colonna[1], 2) ^ colonna[1] ^ multiplicationXN(colonna[2], 3) ^ colonna[2] ^ multiplicationXN(colonna[3], 3) ^
-		multiplicationXN(colonna[3], 2) ^ multiplicationX(colonna[3]);
+	for (i = 0; i < 16; i++)
+		sBox[i] = (word8)value[i];
+
+	for (i = 0; i < 4; i++){
+		for (j = 0; j < 4; j++){
+			if (n == 20)
+				mixMatrix[i][j] = (word8)value[16 + ((j - i + 4) % 4)];
+			else
+				mixMatrix[i][j] = (word8)value[16 + 4 * i + j];
+		}
+	}
+
+	return initializationSPN();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*Partial inverse mixcolumn - only on the first column*/
+
+void partialInvMixColumn(word8 *p){
+
+	int j;
+	unsigned short nuovaColonna;
+
+	//calcolo nuova colonna
+	nuovaColonna = invMixTable[0][*p] ^ invMixTable[1][*(p + 1)] ^ invMixTable[2][*(p + 2)] ^ invMixTable[3][*(p + 3)];
 
 	//reinserisco colonna
 	for (j = 0; j<4; j++){
-		*(p + j) = nuovaColonna[j];
+		*(p + j) = (word8)((nuovaColonna >> (4 * j)) & 0xf);
 	}
 }
 
@@ -306,25 +617,37 @@ void partialInvMixColumn(word8 *p){
 void mixColumn(word8 *p){
 
 	int i, j;
-	word8 colonna[4], nuovaColonna[4];
+	unsigned short nuovaColonna;
 
-	//separo le colonne e calcolo le nuove
 	for (i = 0; i<4; i++){
 
-		//prendo la colonna i-sima
+		//calcolo nuova colonna i-sima
+		nuovaColonna = mixTable[0][*(p + i)] ^ mixTable[1][*(p + i + 4)] ^ mixTable[2][*(p + i + 8)] ^ mixTable[3][*(p + i + 12)];
+
+		//reinserisco colonna
 		for (j = 0; j<4; j++){
-			colonna[j] = *(p + i + 4 * j);
+			*(p + i + 4 * j) = (word8)((nuovaColonna >> (4 * j)) & 0xf);
 		}
 
-		//calcolo nuova colonna
-		nuovaColonna[0] = multiplicationX(colonna[0]) ^ multiplicationX(colonna[1]) ^ colonna[1] ^ colonna[2] ^ colonna[3];
-		nuovaColonna[1] = colonna[0] ^ multiplicationX(colonna[1]) ^ multiplicationX(colonna[2]) ^ colonna[2] ^ colonna[3];
-		nuovaColonna[2] = colonna[0] ^ colonna[1] ^ multiplicationX(colonna[2]) ^ multiplicationX(colonna[3]) ^ colonna[3];
-		nuovaColonna[3] = multiplicationX(colonna[0]) ^ colonna[0] ^ colonna[1] ^ colonna[2] ^ multiplicationX(colonna[3]);
+	}
+
+}
+
+/*Inverse MixColumn - all the columns*/
+
+void inverseMixColumn(word8 *p){
+
+	int i, j;
+	unsigned short nuovaColonna;
+
+	for (i = 0; i<4; i++){
+
+		//calcolo nuova colonna i-sima
+		nuovaColonna = invMixTable[0][*(p + i)] ^ invMixTable[1][*(p + i + 4)] ^ invMixTable[2][*(p + i + 8)] ^ invMixTable[3][*(p + i + 12)];
 
 		//reinserisco colonna
 		for (j = 0; j<4; j++){
-			*(p + i + 4 * j) = nuovaColonna[j];
+			*(p + i + 4 * j) = (word8)((nuovaColonna >> (4 * j)) & 0xf);
 		}
 
 	}
@@ -521,6 +844,54 @@ void generationRoundKey2(word8 *pKey, int numeroRound, word8 *pKeyPrecedente){
 
 }
 
+/*Inverse of generationRoundKey: from the key of the round numeroRound + 1 to the one of the round numeroRound*/
+
+void inverseGenerationRoundKey(word8 *pKey, int numeroRound){
+
+	int i, j;
+
+	word8 colonnaTemp[4];
+
+	//altre colonne (dall'ultima)
+	for (i = 3; i>0; i--){
+
+		for (j = 0; j<4; j++){
+			*(pKey + i + 4 * j) = *(pKey + i + 4 * j) ^ *(pKey + i + 4 * j - 1);
+		}
+
+	}
+
+	//prima colonna, con la terza colonna della chiave precedente
+	for (i = 0; i<4; i++)
+		colonnaTemp[i] = *(pKey + 3 + 4 * i);
+
+	nuovaColonna(&(colonnaTemp[0]), numeroRound);
+
+	for (i = 0; i<4; i++)
+		*(pKey + 4 * i) = *(pKey + 4 * i) ^ colonnaTemp[i];
+
+}
+
+/*Key of the last round (nRounds) from the master key, and master key from the key of the last round*/
+
+void lastRoundKey(word8 initialKey[][4], word8 lastKey[][4], int nRounds){
+
+	int i;
+
+	initialization(&(lastKey[0][0]), initialKey);
+	for (i = 0; i<nRounds; i++)
+		generationRoundKey(&(lastKey[0][0]), i);
+}
+
+void masterKey(word8 lastKey[][4], word8 initialKey[][4], int nRounds){
+
+	int i;
+
+	initialization(&(initialKey[0][0]), lastKey);
+	for (i = nRounds - 1; i >= 0; i--)
+		inverseGenerationRoundKey(&(initialKey[0][0]), i);
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 /*shift rows*/
@@ -543,14 +914,32 @@ void shiftRows(word8 *p){
 
 }
 
+/*inverse shift rows*/
+
+void inverseShiftRows(word8 *p){
+
+	word8 temp[4];
+	int i, j;
+
+	for (i = 1; i<4; i++){
+		for (j = 0; j<4; j++)
+			temp[j] = *(p + 4 * i + j);
+
+		for (j = 0; j<4; j++)
+			*(p + 4 * i + (j + i) % 4) = temp[j];
+	}
+
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 /**Encryption:
 NOTE: we're using a reduced version of AES, with nibble instead of byte (that is, 4 bits instead of 8).
 We refer to "Small Scale Variants of the AES" of C. Cid, S. Murphy, and M.J.B. Robshaw for a complete description.
+encryptionRounds works on nRounds rounds (the last one without MixColumns), encryption on N_Round rounds.
 */
 
-void encryption(word8 initialMessage[][4], word8 initialKey[][4], word8 *ciphertext){
+void encryptionRounds(word8 initialMessage[][4], word8 initialKey[][4], word8 *ciphertext, int nRounds){
 
 	int i, j;
 
@@ -566,7 +955,7 @@ void encryption(word8 initialMessage[][4], word8 initialKey[][4], word8 *ciphert
 	addRoundKey(&(state[0][0]), key);
 
 	//Round
-	for (i = 0; i<N_Round - 1; i++){
+	for (i = 0; i<nRounds - 1; i++){
 		generationRoundKey(&(key[0][0]), i);
 		byteSubTransformation(&(state[0][0]));
 		shiftRows(&(state[0][0]));
@@ -576,7 +965,7 @@ void encryption(word8 initialMessage[][4], word8 initialKey[][4], word8 *ciphert
 	}
 
 	//Final Round
-	generationRoundKey(&(key[0][0]), N_Round - 1);
+	generationRoundKey(&(key[0][0]), nRounds - 1);
 	byteSubTransformation(&(state[0][0]));
 	shiftRows(&(state[0][0]));
 	addRoundKey(&(state[0][0]), key);
@@ -589,479 +978,4933 @@ void encryption(word8 initialMessage[][4], word8 initialKey[][4], word8 *ciphert
 
 }
 
-/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void encryption(word8 initialMessage[][4], word8 initialKey[][4], word8 *ciphertext){
 
-/*Suppose that p = p1 \xor p2, that is the sum of two plaintexts.
-I ask myself if it belong to a subspace D:
-0 - not belong;
-1 - belong to D (dim 12)
+	encryptionRounds(initialMessage, initialKey, ciphertext, N_Round);
+}
+
+/**Encryption with the fused tables (sBoxMixTable): same result of encryption, with the state packed by columns.
+initializationSPN() must be called before.
 */
 
-int belongToU(word8 p[][4])
-{
-	if ((p[0][0] == 0) && (p[1][1] == 0) && (p[2][2] == 0) && (p[3][3] == 0))
-		return 1;
+void encryptionFused(word8 initialMessage[][4], word8 initialKey[][4], word8 *ciphertext){
 
-	if ((p[1][0] == 0) && (p[2][1] == 0) && (p[3][2] == 0) && (p[0][3] == 0))
-		return 1;
+	int i, r, c;
+	unsigned short colonna[4], nuovaColonna[4];
+	word8 key[4][4];
 
-	if ((p[2][0] == 0) && (p[3][1] == 0) && (p[0][2] == 0) && (p[1][3] == 0))
-		return 1;
+	initialization(&(key[0][0]), initialKey);
 
-	if ((p[3][0] == 0) && (p[0][1] == 0) && (p[1][2] == 0) && (p[2][3] == 0))
-		return 1;
+	//Initial Round
+	for (c = 0; c<4; c++){
+		colonna[c] = 0;
+		for (r = 0; r<4; r++)
+			colonna[c] |= (unsigned short)((initialMessage[r][c] ^ key[r][c]) << (4 * r));
+	}
 
-	return 0;
+	//Round: byte sub transformation, shift rows and mixcolumn by the tables
+	for (i = 0; i<N_Round - 1; i++){
+		generationRoundKey(&(key[0][0]), i);
 
-}
+		for (c = 0; c<4; c++){
+			nuovaColonna[c] = sBoxMixTable[0][colonna[c] & 0xf] ^ sBoxMixTable[1][(colonna[(c + 1) % 4] >> 4) & 0xf] ^
+				sBoxMixTable[2][(colonna[(c + 2) % 4] >> 8) & 0xf] ^ sBoxMixTable[3][colonna[(c + 3) % 4] >> 12] ^
+				(unsigned short)(key[0][c] | (key[1][c] << 4) | (key[2][c] << 8) | (key[3][c] << 12));
+		}
 
-//Similar to the previous one, but with C instead of D,
+		for (c = 0; c<4; c++)
+			colonna[c] = nuovaColonna[c];
+	}
 
-int belongToV(word8 p[][4])
-{
-	if ((p[0][0] == 0) && (p[1][0] == 0) && (p[2][0] == 0) && (p[3][0] == 0))
-		return 1;
+	//Final Round
+	generationRoundKey(&(key[0][0]), N_Round - 1);
+	for (r = 0; r<4; r++){
+		for (c = 0; c<4; c++)
+			*(ciphertext + c + 4 * r) = sBox[(colonna[(c + r) % 4] >> (4 * r)) & 0xf] ^ key[r][c];
+	}
 
-	if ((p[0][1] == 0) && (p[1][1] == 0) && (p[2][1] == 0) && (p[3][1] == 0))
-		return 1;
+}
 
-	if ((p[0][2] == 0) && (p[1][2] == 0) && (p[2][2] == 0) && (p[3][2] == 0))
-		return 1;
+/**Encryption for the collisions only: the distinguisher uses the ciphertexts only to check whether two of them are equal on an
+anti-diagonal c (belongToW), and this is decided some rounds before:
+- the last round (S-box, shift rows, key) works nibble by nibble: two ciphertexts are equal on the anti-diagonal c if and only if
+  the states x_{N_Round-1} before it are equal on the column c (and the last key cancels);
+- x_{N_Round-1} = MC(SR(SB(x_{N_Round-2}))) ^ k: MixColumns is invertible on each column and the S-box on each nibble, so the
+  column c of x_{N_Round-1} is equal if and only if the nibbles (r, c + r) of x_{N_Round-2} are equal, and the key k_{N_Round-2}
+  cancels too.
+So encryptionCollision computes MC(SR(SB(x_{N_Round-3}))), without the key of the round N_Round-2 and without the last 2 rounds,
+and writes the nibble (r, c + r) in the position 4*c + r: the collision of two ciphertexts is an equal group of 4 positions
+(a zero 16-bit lane of the xor of the packed states, see collisionTestDiagonal). The outcome of the distinguisher is the same
+of encryption (checked by selfTestCollisionForm). N_Round >= 3.
+*/
 
-	if ((p[0][3] == 0) && (p[1][3] == 0) && (p[2][3] == 0) && (p[3][3] == 0))
-		return 1;
+void encryptionCollision(word8 initialMessage[][4], word8 initialKey[][4], word8 *state){
 
-	return 0;
+	int i, r, c;
+	unsigned short colonna[4], nuovaColonna[4];
+	word8 key[4][4];
 
-}
+	initialization(&(key[0][0]), initialKey);
 
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	//Initial Round
+	for (c = 0; c<4; c++){
+		colonna[c] = 0;
+		for (r = 0; r<4; r++)
+			colonna[c] |= (unsigned short)((initialMessage[r][c] ^ key[r][c]) << (4 * r));
+	}
 
-/*Suppose that p = p1 \xor p2, that is the sum of two plaintexts.
-I ask myself if it belong to a subspace M:
-0 - not belong;
-1 - belong to W (dim 12)
-*/
+	//Round, up to N_Round-3 (with the key)
+	for (i = 0; i<N_Round - 3; i++){
+		generationRoundKey(&(key[0][0]), i);
 
-int belongToW(word8 p[][4])
-{
-	/*Consider MC^-1(W) since no mixcolumns at the end!*/
+		for (c = 0; c<4; c++){
+			nuovaColonna[c] = sBoxMixTable[0][colonna[c] & 0xf] ^ sBoxMixTable[1][(colonna[(c + 1) % 4] >> 4) & 0xf] ^
+				sBoxMixTable[2][(colonna[(c + 2) % 4] >> 8) & 0xf] ^ sBoxMixTable[3][colonna[(c + 3) % 4] >> 12] ^
+				(unsigned short)(key[0][c] | (key[1][c] << 4) | (key[2][c] << 8) | (key[3][c] << 12));
+		}
 
-	if ((p[0][0] == 0) && (p[3][1] == 0) && (p[2][2] == 0) && (p[1][3] == 0))
-		return 1;
+		for (c = 0; c<4; c++)
+			colonna[c] = nuovaColonna[c];
+	}
 
-	if ((p[1][0] == 0) && (p[0][1] == 0) && (p[3][2] == 0) && (p[2][3] == 0))
-		return 1;
+	//Round N_Round-2, without the key
+	for (c = 0; c<4; c++){
+		nuovaColonna[c] = sBoxMixTable[0][colonna[c] & 0xf] ^ sBoxMixTable[1][(colonna[(c + 1) % 4] >> 4) & 0xf] ^
+			sBoxMixTable[2][(colonna[(c + 2) % 4] >> 8) & 0xf] ^ sBoxMixTable[3][colonna[(c + 3) % 4] >> 12];
+	}
 
-	if ((p[2][0] == 0) && (p[1][1] == 0) && (p[0][2] == 0) && (p[3][3] == 0))
-		return 1;
+	for (c = 0; c<4; c++){
+		for (r = 0; r<4; r++)
+			*(state + 4 * c + r) = (word8)((nuovaColonna[(c + r) % 4] >> (4 * r)) & 0xf);
+	}
+
+}
+
+/**Decryption:
+the inverse of encryptionRounds (nRounds rounds, the last one without MixColumns). The key of the decryption is the key of the last
+round (see lastRoundKey): the round keys are computed backwards by inverseGenerationRoundKey, so the decryption costs the same as the
+encryption, and masterKey gives back the key of encryption.
+decryptionFused works by columns as encryptionFused: inverse MixColumns is linear, so MC^-1(x ^ k) = MC^-1(x) ^ MC^-1(k) and each
+round is 4 lookups of invSBoxMixTable for each column (inverse S-box and inverse shift rows of the previous round included) and the
+key MC^-1(k) of the round.
+*/
+
+void decryptionRounds(word8 initialCiphertext[][4], word8 lastKey[][4], word8 *plaintext, int nRounds){
+
+	int i, j;
+
+	//initialization state
+	unsigned char state[4][4];
+	initialization(&(state[0][0]), initialCiphertext);
+
+	//initialization key
+	unsigned char key[4][4];
+	initialization(&(key[0][0]), lastKey);
+
+	//Final Round
+	addRoundKey(&(state[0][0]), key);
+	inverseShiftRows(&(state[0][0]));
+	inverseByteSubTransformation(&(state[0][0]));
+
+	//Round
+	for (i = nRounds - 1; i>0; i--){
+		inverseGenerationRoundKey(&(key[0][0]), i);
+		addRoundKey(&(state[0][0]), key);
+		inverseMixColumn(&(state[0][0]));
+		inverseShiftRows(&(state[0][0]));
+		inverseByteSubTransformation(&(state[0][0]));
+	}
+
+	//Initial Round
+	inverseGenerationRoundKey(&(key[0][0]), 0);
+	addRoundKey(&(state[0][0]), key);
+
+	//store plaintext!
+	for (i = 0; i<4; i++){
+		for (j = 0; j<4; j++)
+			*(plaintext + j + 4 * i) = state[i][j];
+	}
+
+}
+
+void decryption(word8 initialCiphertext[][4], word8 lastKey[][4], word8 *plaintext){
+
+	decryptionRounds(initialCiphertext, lastKey, plaintext, N_Round);
+}
+
+void decryptionFused(word8 initialCiphertext[][4], word8 lastKey[][4], word8 *plaintext){
+
+	int i, r, c;
+	unsigned short colonna[4], nuovaColonna[4], chiave;
+	word8 key[4][4];
+
+	initialization(&(key[0][0]), lastKey);
+
+	//Final Round: add round key (inverse shift rows and inverse S-box in the next round)
+	for (c = 0; c<4; c++){
+		colonna[c] = 0;
+		for (r = 0; r<4; r++)
+			colonna[c] |= (unsigned short)((initialCiphertext[r][c] ^ key[r][c]) << (4 * r));
+	}
+
+	//Round: inverse shift rows, inverse S-box, inverse mixcolumn by the tables, and MC^-1 of the key
+	for (i = N_Round - 1; i>0; i--){
+		inverseGenerationRoundKey(&(key[0][0]), i);
+
+		for (c = 0; c<4; c++){
+			chiave = invMixTable[0][key[0][c]] ^ invMixTable[1][key[1][c]] ^ invMixTable[2][key[2][c]] ^ invMixTable[3][key[3][c]];
+			nuovaColonna[c] = invSBoxMixTable[0][colonna[c] & 0xf] ^ invSBoxMixTable[1][(colonna[(c + 3) % 4] >> 4) & 0xf] ^
+				invSBoxMixTable[2][(colonna[(c + 2) % 4] >> 8) & 0xf] ^ invSBoxMixTable[3][colonna[(c + 1) % 4] >> 12] ^ chiave;
+		}
+
+		for (c = 0; c<4; c++)
+			colonna[c] = nuovaColonna[c];
+	}
+
+	//Initial Round
+	inverseGenerationRoundKey(&(key[0][0]), 0);
+	for (r = 0; r<4; r++){
+		for (c = 0; c<4; c++)
+			*(plaintext + c + 4 * r) = inv_s[(colonna[(c - r + 4) % 4] >> (4 * r)) & 0xf] ^ key[r][c];
+	}
+
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**Encryption - full AES (bytes instead of nibbles):
+same structure of encryption (initial key addition, N_Round-1 rounds, final round without MixColumns), same key schedule, same
+layout of the state (row i, column j; the ciphertext in position j + 4*i), but on bytes - with nRounds = 10 it is AES-128.
+If the CPU supports it, the rounds are computed with AES-NI (aesenc/aesenclast, the last one has no MixColumns);
+otherwise, with the tables te[r] that merge S-box and MixColumns (row r of the input column).
+initializationAES8() must be called before.
+*/
+
+word8 sBox8[256], inv_s8[256];
+unsigned int te[4][256];
+int aesNI = 0;
+
+/*Multiplication in GF(2^8), x^8 + x^4 + x^3 + x + 1*/
+
+word8 multiplication8(word8 a, word8 b){
+
+	word8 result = 0;
+
+	while (b != 0){
+		if (b & 0x1)
+			result ^= a;
+		a = (word8)((a << 1) ^ ((a & 0x80) ? 0x1b : 0x00));
+		b >>= 1;
+	}
+
+	return result;
+}
+
+void initializationAES8(){
+
+	int i, j;
+	word8 inverse, s;
+
+	for (i = 0; i < 256; i++){
+
+		//multiplicative inverse (0 -> 0)
+		inverse = 0;
+		for (j = 1; (j < 256) && (i != 0); j++){
+			if (multiplication8((word8)i, (word8)j) == 1){
+				inverse = (word8)j;
+				break;
+			}
+		}
+
+		//affine transformation
+		s = inverse;
+		for (j = 1; j < 5; j++)
+			s ^= (word8)((inverse << j) | (inverse >> (8 - j)));
+		s ^= 0x63;
+
+		sBox8[i] = s;
+		inv_s8[s] = (word8)i;
+	}
+
+	//te[r][x]: S-box of x in the row r of the column, multiplied by the column r of MixColumns (2, 3, 1, 1 circulant)
+	for (i = 0; i < 256; i++){
+		s = sBox8[i];
+		te[0][i] = (unsigned int)multiplication8(s, 2) | ((unsigned int)s << 8) | ((unsigned int)s << 16) | ((unsigned int)multiplication8(s, 3) << 24);
+		for (j = 1; j < 4; j++)
+			te[j][i] = (te[j - 1][i] << 8) | (te[j - 1][i] >> 24);
+	}
+
+#if defined(__x86_64__) || defined(__i386__)
+	aesNI = __builtin_cpu_supports("aes");
+#endif
+}
+
+/*Round keys of AES-128 (same key schedule of generationRoundKey) - roundKey[n][r + 4*c] = key of round n in the row r, column c*/
+
+void expansionKeyAES8(word8 initialKey[][4], word8 roundKey[][16], int nRounds){
+
+	int n, r, c;
+	word8 rCostante = 0x1, colonnaTemp[4];
+
+	for (r = 0; r < 4; r++){
+		for (c = 0; c < 4; c++)
+			roundKey[0][r + 4 * c] = initialKey[r][c];
+	}
+
+	for (n = 1; n <= nRounds; n++){
+
+		for (r = 0; r < 4; r++)
+			colonnaTemp[r] = sBox8[roundKey[n - 1][((r + 1) % 4) + 12]];
+		colonnaTemp[0] ^= rCostante;
+		rCostante = multiplication8(rCostante, 2);
+
+		for (r = 0; r < 4; r++)
+			roundKey[n][r] = roundKey[n - 1][r] ^ colonnaTemp[r];
+
+		for (c = 1; c < 4; c++){
+			for (r = 0; r < 4; r++)
+				roundKey[n][r + 4 * c] = roundKey[n - 1][r + 4 * c] ^ roundKey[n][r + 4 * (c - 1)];
+		}
+	}
+}
+
+/*Table version - state[r + 4*c]*/
+
+void encryptionAES8Table(word8 *state, word8 roundKey[][16], int nRounds){
+
+	int n, r, c;
+	unsigned int column;
+	word8 temp[16];
+
+	for (r = 0; r < 16; r++)
+		state[r] ^= roundKey[0][r];
+
+	for (n = 1; n < nRounds; n++){
+		for (c = 0; c < 4; c++){
+			column = te[0][state[4 * c]] ^ te[1][state[1 + 4 * ((c + 1) % 4)]] ^ te[2][state[2 + 4 * ((c + 2) % 4)]] ^ te[3][state[3 + 4 * ((c + 3) % 4)]];
+			for (r = 0; r < 4; r++)
+				temp[r + 4 * c] = (word8)(column >> (8 * r)) ^ roundKey[n][r + 4 * c];
+		}
+		for (r = 0; r < 16; r++)
+			state[r] = temp[r];
+	}
+
+	//final round, no MixColumns
+	for (c = 0; c < 4; c++){
+		for (r = 0; r < 4; r++)
+			temp[r + 4 * c] = sBox8[state[r + 4 * ((c + r) % 4)]] ^ roundKey[nRounds][r + 4 * c];
+	}
+	for (r = 0; r < 16; r++)
+		state[r] = temp[r];
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <wmmintrin.h>
+
+/*AES-NI version - state[r + 4*c] is exactly the byte order of the xmm register*/
+
+__attribute__((target("aes,sse2")))
+void encryptionAES8NI(word8 *state, word8 roundKey[][16], int nRounds){
+
+	int n;
+	__m128i s;
+
+	s = _mm_xor_si128(_mm_loadu_si128((const __m128i *)state), _mm_loadu_si128((const __m128i *)roundKey[0]));
+
+	for (n = 1; n < nRounds; n++)
+		s = _mm_aesenc_si128(s, _mm_loadu_si128((const __m128i *)roundKey[n]));
+
+	s = _mm_aesenclast_si128(s, _mm_loadu_si128((const __m128i *)roundKey[nRounds]));
+
+	_mm_storeu_si128((__m128i *)state, s);
+}
+
+#endif
+
+void encryptionAES8Rounds(word8 initialMessage[][4], word8 initialKey[][4], word8 *ciphertext, int nRounds){
+
+	int i, j;
+	word8 state[16], roundKey[15][16];
+
+	expansionKeyAES8(initialKey, roundKey, nRounds);
+
+	for (i = 0; i < 4; i++){
+		for (j = 0; j < 4; j++)
+			state[i + 4 * j] = initialMessage[i][j];
+	}
+
+#if defined(__x86_64__) || defined(__i386__)
+	if (aesNI)
+		encryptionAES8NI(state, roundKey, nRounds);
+	else
+#endif
+		encryptionAES8Table(state, roundKey, nRounds);
+
+	for (i = 0; i < 4; i++){
+		for (j = 0; j < 4; j++)
+			*(ciphertext + j + 4 * i) = state[i + 4 * j];
+	}
+}
+
+void encryptionAES8(word8 initialMessage[][4], word8 initialKey[][4], word8 *ciphertext){
+
+	encryptionAES8Rounds(initialMessage, initialKey, ciphertext, N_Round);
+}
+
+/*Inverse byte sub transformation and partial inverse mixcolumn (first column) for the full AES*/
+
+word8 inverseByteTransformationAES8(word8 byte){
+
+	return inv_s8[byte];
+}
+
+void partialInvMixColumnAES8(word8 *p){
+
+	int j;
+	word8 colonna[4];
+
+	for (j = 0; j<4; j++){
+		colonna[j] = *(p + j);
+	}
+
+	for (j = 0; j<4; j++){
+		*(p + j) = multiplication8(colonna[j], 0x0e) ^ multiplication8(colonna[(j + 1) % 4], 0x0b) ^
+			multiplication8(colonna[(j + 2) % 4], 0x0d) ^ multiplication8(colonna[(j + 3) % 4], 0x09);
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**TELEMETRY:
+the sweeps update the counters of telemetry (relaxed atomic additions, once for each candidate - or for each test in
+fullKeyRecovery - never in the inner loops). If startTelemetry is called, a thread publishes every period seconds candidates
+done/remaining, encryptions and tests per second, survivors and ETA as a JSON object:
+- in the file statsFile (written in statsFile.tmp and then renamed, so a reader always sees a complete file);
+- on http://127.0.0.1:port/ if port > 0: a client has TELEMETRY_CLIENT_TIMEOUT ms to send its request, and the thread waits for the
+  connections in slices of TELEMETRY_SLICE ms, so it sees stopTelemetry in time.
+Without port, the thread waits on telemetryWake, and stopTelemetry wakes it at once.
+*/
+
+#define TELEMETRY_CLIENT_TIMEOUT 1000
+#define TELEMETRY_SLICE 100
+
+typedef struct{
+	std::atomic<long long> candidatesDone, candidatesTotal, encryptions, tests, survivors;
+} telemetryCounters;
+
+telemetryCounters telemetry;
+
+std::atomic<int> telemetryRunning;
+std::thread telemetryThread;
+std::mutex telemetryLock;
+std::condition_variable telemetryWake;
+
+void resetTelemetry(long long candidatesTotal){
+
+	telemetry.candidatesDone.store(0);
+	telemetry.candidatesTotal.store(candidatesTotal);
+	telemetry.encryptions.store(0);
+	telemetry.tests.store(0);
+	telemetry.survivors.store(0);
+}
+
+/*One candidate done, after numberTests tests of numberTexts texts each*/
+
+void telemetryCandidate(long long numberTests, long long numberTexts, int survived){
+
+	telemetry.tests.fetch_add(numberTests, std::memory_order_relaxed);
+	telemetry.encryptions.fetch_add(numberTests * numberTexts, std::memory_order_relaxed);
+	telemetry.candidatesDone.fetch_add(1, std::memory_order_relaxed);
+	if (survived)
+		telemetry.survivors.fetch_add(1, std::memory_order_relaxed);
+}
+
+int telemetryJSON(char *buffer, int size, double elapsed, double encryptionsPerSecond, double testsPerSecond, double candidatesPerSecond){
+
+	long long done = telemetry.candidatesDone.load(std::memory_order_relaxed), total = telemetry.candidatesTotal.load(std::memory_order_relaxed);
+	double eta = (candidatesPerSecond > 0) ? (total - done) / candidatesPerSecond : -1.0;
+
+	return snprintf(buffer, size, "{\"elapsed\": %.1f, \"candidates_done\": %lld, \"candidates_remaining\": %lld, \"encryptions\": %lld, "
+		"\"tests\": %lld, \"encryptions_per_second\": %.0f, \"tests_per_second\": %.0f, \"survivors\": %lld, \"eta_seconds\": %.0f}\n",
+		elapsed, done, total - done, telemetry.encryptions.load(std::memory_order_relaxed), telemetry.tests.load(std::memory_order_relaxed),
+		encryptionsPerSecond, testsPerSecond, telemetry.survivors.load(std::memory_order_relaxed), eta);
+}
+
+void telemetryLoop(const char *statsFile, int port, double period){
+
+	FILE *fp;
+	char buffer[512], tmpFile[1024];
+	int length = 0;
+	long long lastEncryptions = 0, lastTests = 0, lastDone = 0, encryptions, tests, done;
+	double elapsed, lastElapsed = 0.0, delta, wait;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	int server = -1, client;
+
+#if defined(__unix__) || defined(__APPLE__)
+	struct sockaddr_in address;
+	struct pollfd descriptor;
+	struct timeval timeout;
+	int option = 1;
+
+	if (port > 0){
+		server = socket(AF_INET, SOCK_STREAM, 0);
+		memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		address.sin_port = htons((unsigned short)port);
+		setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &option, sizeof(option));
+		if ((server < 0) || (bind(server, (struct sockaddr *)&address, sizeof(address)) != 0) || (listen(server, 4) != 0)){
+			printf("Telemetry: cannot listen on port %d.\n", port);
+			if (server >= 0)
+				close(server);
+			server = -1;
+		}
+	}
+#endif
+
+	length = telemetryJSON(buffer, sizeof(buffer), 0.0, 0.0, 0.0, 0.0);
+	snprintf(tmpFile, sizeof(tmpFile), "%s.tmp", (statsFile != NULL) ? statsFile : "");
+
+	while (telemetryRunning.load())
+	{
+		//wait for the rest of the period, answering the HTTP requests in the meantime
+		wait = period - (std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() - lastElapsed);
+		if (wait < 0.0)
+			wait = 0.0;
+#if defined(__unix__) || defined(__APPLE__)
+		if (server >= 0){
+			descriptor.fd = server;
+			descriptor.events = POLLIN;
+			if (poll(&descriptor, 1, (wait * 1000 < TELEMETRY_SLICE) ? (int)(wait * 1000) : TELEMETRY_SLICE) > 0){
+				client = accept(server, NULL, NULL);
+				if (client >= 0){
+					char request[1024], header[128];
+					int headerLength;
+
+					//a client that sends nothing must not stop the thread
+					timeout.tv_sec = TELEMETRY_CLIENT_TIMEOUT / 1000;
+					timeout.tv_usec = (TELEMETRY_CLIENT_TIMEOUT % 1000) * 1000;
+					setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+					setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+					if (recv(client, request, sizeof(request), 0) > 0){
+						headerLength = snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\nContent-Type: application/json\r\nContent-Length: %d\r\n\r\n", length);
+						send(client, header, headerLength, 0);
+						send(client, buffer, length, 0);
+					}
+					close(client);
+				}
+			}
+		}
+		else
+#endif
+		{
+			std::unique_lock<std::mutex> lock(telemetryLock);
+			telemetryWake.wait_for(lock, std::chrono::milliseconds((long)(wait * 1000)), []{ return telemetryRunning.load() == 0; });
+		}
+
+		//at the stop, the last values are published at once
+		elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if ((elapsed - lastElapsed < period) && (telemetryRunning.load() != 0))
+			continue;
+		if (elapsed <= lastElapsed)
+			continue;
+
+		encryptions = telemetry.encryptions.load(std::memory_order_relaxed);
+		tests = telemetry.tests.load(std::memory_order_relaxed);
+		done = telemetry.candidatesDone.load(std::memory_order_relaxed);
+		delta = elapsed - lastElapsed;
+
+		length = telemetryJSON(buffer, sizeof(buffer), elapsed, (encryptions - lastEncryptions) / delta, (tests - lastTests) / delta, (done - lastDone) / delta);
+
+		lastEncryptions = encryptions;
+		lastTests = tests;
+		lastDone = done;
+		lastElapsed = elapsed;
+
+		if (statsFile != NULL){
+			fp = fopen(tmpFile, "w");
+			if (fp != NULL){
+				fputs(buffer, fp);
+				fclose(fp);
+				rename(tmpFile, statsFile);
+			}
+		}
+	}
+
+#if defined(__unix__) || defined(__APPLE__)
+	if (server >= 0)
+		close(server);
+#endif
+}
+
+void startTelemetry(const char *statsFile, int port, double period){
+
+	telemetryRunning.store(1);
+	telemetryThread = std::thread(telemetryLoop, statsFile, port, period);
+}
+
+void stopTelemetry(){
+
+	if (telemetryRunning.load()){
+		{
+			std::lock_guard<std::mutex> lock(telemetryLock);
+			telemetryRunning.store(0);
+		}
+		telemetryWake.notify_all();
+		telemetryThread.join();
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**RESULT SINK:
+each sweep is a run (resultBeginRun ... resultEndRun), and each candidate that survives - or each candidate, if results.all = 1 - is
+a record with the tests executed and the collisions: the sweeps stop at the first test with a collision, and collisions is the
+number of pairs with a collision in that test (0 if the candidate survives).
+The records are buffered (RESULT_BUFFER_SIZE) under a mutex, so the lanes of the pipeline can share the sink, and are written:
+- in binary (-bin file): resultRecord as it is (48 bytes, native byte order, the fields after kind and mode depend on kind);
+- as JSON lines (-json file): one object for each record, with "type" = "run", "candidate" or "summary".
+Every record carries the identifier of the run, so the files of different threads, runs and nodes can be merged by concatenation.
+If a sink is open, the console shows only a summary of each sweep (unless -verbose).
+*/
+
+#define RESULT_BUFFER_SIZE 4096
+
+#define RESULT_RUN 0
+#define RESULT_CANDIDATE 1
+#define RESULT_SUMMARY 2
+
+#define RESULT_AES 0
+#define RESULT_RANDOM 1
+#define RESULT_FULLKEY 2
+#define RESULT_INTEGRAL 3
+#define RESULT_CHOSEN_CIPHERTEXT 4
+
+#define RESULT_SURVIVOR 0x1
+#define RESULT_RIGHT_KEY 0x2
+#define RESULT_SECOND_STRUCTURE 0x4/* RESULT_CHOSEN_CIPHERTEXT: it survived the first structure (see CHOSEN-CIPHERTEXT DISTINGUISHER) */
+
+const char *resultModeName[5] = { "aes", "random", "fullkey", "integral", "ciphertext" };
+
+/*The fields after kind and mode depend on kind:
+- RESULT_RUN: begin;
+- RESULT_CANDIDATE: candidate - diagonal = diagonal of the round-0 key (anti-diagonal of the last round key for RESULT_INTEGRAL and
+  RESULT_CHOSEN_CIPHERTEXT; for RESULT_INTEGRAL, tests = sets and collisions = 1 if a set eliminated the guess);
+- RESULT_SUMMARY: summary.
+*/
+
+typedef struct{
+	word64 run;
+	word8 kind, mode, reserved[6];
+	union{
+		struct{
+			word64 first, last;/* candidates in [first, last) */
+			word64 testBudget;/* tests for each candidate */
+			unsigned int lanes;/* lanes of the pipeline (0 if not pipelined) */
+			unsigned int cellBits;
+		} begin;
+		struct{
+			word64 candidate;/* k1 in the most significant cell */
+			word64 tests;/* tests executed */
+			unsigned int collisions;/* pairs with a collision in the last test */
+			word8 diagonal, flags, reserved[2];/* flags = RESULT_SURVIVOR | RESULT_RIGHT_KEY | RESULT_SECOND_STRUCTURE */
+		} candidate;
+		struct{
+			word64 candidates, survivors;/* candidates done */
+			word64 milliseconds;/* elapsed */
+			unsigned int cancelled;/* 1 if the sweep has been cancelled before the end */
+		} summary;
+	};
+} resultRecord;
+
+typedef struct{
+	FILE *json, *binary;
+	int all, console;
+	std::mutex lock;
+	resultRecord buffer[RESULT_BUFFER_SIZE];
+	int nBuffer;
+	word64 run;
+	int mode, cellBits, pid;
+	char host[64];
+	std::chrono::steady_clock::time_point start;
+} resultSink;
+
+resultSink results = { NULL, NULL, 0, 1, {}, {}, 0, 0, 0, 0, 0, "", {} };
+
+int resultOpen(const char *jsonFile, const char *binaryFile){
+
+	if (jsonFile != NULL)
+	{
+		results.json = fopen(jsonFile, "a");
+		if (results.json == NULL)
+		{
+			printf("Cannot open %s.\n", jsonFile);
+			return 1;
+		}
+	}
+
+	if (binaryFile != NULL)
+	{
+		results.binary = fopen(binaryFile, "ab");
+		if (results.binary == NULL)
+		{
+			printf("Cannot open %s.\n", binaryFile);
+			return 1;
+		}
+	}
+
+	strcpy(results.host, "unknown");
+	results.pid = 0;
+#if defined(__unix__) || defined(__APPLE__)
+	gethostname(results.host, sizeof(results.host) - 1);
+	results.pid = (int)getpid();
+#endif
+
+	return 0;
+}
+
+/*Write the buffered records - the caller holds results.lock*/
+
+void resultFlush(){
+
+	int i, l;
+	resultRecord *r;
+
+	if (results.binary != NULL)
+		fwrite(results.buffer, sizeof(resultRecord), results.nBuffer, results.binary);
+
+	for (i = 0; (i < results.nBuffer) && (results.json != NULL); i++)
+	{
+		r = &(results.buffer[i]);
+
+		if (r->kind == RESULT_RUN)
+			fprintf(results.json, "{\"type\": \"run\", \"run\": \"%016llx\", \"host\": \"%s\", \"pid\": %d, \"mode\": \"%s\", \"n_round\": %d, "
+			"\"n_test\": %llu, \"cell_bits\": %u, \"lanes\": %u, \"first\": %llu, \"last\": %llu}\n", r->run, results.host, results.pid,
+			resultModeName[r->mode], N_Round, r->begin.testBudget, r->begin.cellBits, r->begin.lanes, r->begin.first, r->begin.last);
+		else if (r->kind == RESULT_SUMMARY)
+			fprintf(results.json, "{\"type\": \"summary\", \"run\": \"%016llx\", \"mode\": \"%s\", \"candidates\": %llu, \"survivors\": %llu, "
+			"\"elapsed\": %.3f, \"cancelled\": %s}\n", r->run, resultModeName[r->mode], r->summary.candidates, r->summary.survivors,
+			r->summary.milliseconds / 1000.0, (r->summary.cancelled) ? "true" : "false");
+		else
+		{
+			fprintf(results.json, "{\"type\": \"candidate\", \"run\": \"%016llx\", \"mode\": \"%s\", \"diagonal\": %d, \"candidate\": %llu, \"cells\": [",
+				r->run, resultModeName[r->mode], r->candidate.diagonal, r->candidate.candidate);
+			for (l = 0; l < 4; l++)
+				fprintf(results.json, (l < 3) ? "%llu, " : "%llu", (r->candidate.candidate >> (results.cellBits * (3 - l))) & ((1ULL << results.cellBits) - 1));
+			fprintf(results.json, "], \"tests\": %llu, \"collisions\": %u, \"survivor\": %s, \"right_key\": %s", r->candidate.tests,
+				r->candidate.collisions, (r->candidate.flags & RESULT_SURVIVOR) ? "true" : "false", (r->candidate.flags & RESULT_RIGHT_KEY) ? "true" : "false");
+			if (r->mode == RESULT_CHOSEN_CIPHERTEXT)
+				fprintf(results.json, ", \"second_structure\": %s", (r->candidate.flags & RESULT_SECOND_STRUCTURE) ? "true" : "false");
+			fprintf(results.json, "}\n");
+		}
+	}
+
+	results.nBuffer = 0;
+}
+
+void resultPush(resultRecord *r){
+
+	std::lock_guard<std::mutex> lock(results.lock);
+
+	results.buffer[results.nBuffer++] = *r;
+	if (results.nBuffer == RESULT_BUFFER_SIZE)
+		resultFlush();
+}
+
+/*Start of a sweep on the candidates in [first, last)*/
+
+void resultBeginRun(int mode, int cellBits, int nLanes, word64 first, word64 last){
+
+	resultRecord r;
+	word64 x;
+
+	//identifier of the run: splitmix64 of time, pid and the previous one (different for two runs of the same process)
+	x = results.run ^ ((word64)time(NULL) << 20) ^ ((word64)results.pid << 52) ^
+		(word64)std::chrono::steady_clock::now().time_since_epoch().count();
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+
+	results.run = x ^ (x >> 31);
+	results.mode = mode;
+	results.cellBits = cellBits;
+	results.start = std::chrono::steady_clock::now();
+
+	memset(&r, 0, sizeof(r));
+	r.run = results.run;
+	r.kind = RESULT_RUN;
+	r.mode = (word8)mode;
+	r.begin.first = first;
+	r.begin.last = last;
+	r.begin.testBudget = (word64)testBudget;
+	r.begin.lanes = (unsigned int)nLanes;
+	r.begin.cellBits = (unsigned int)cellBits;
+	resultPush(&r);
+}
+
+/*1 if the eliminated candidates are recorded: only then the callers count all the collisions of the last test*/
+
+int resultKeepsEliminated(){
+
+	return (results.all == 1) && ((results.json != NULL) || (results.binary != NULL));
+}
+
+/*One candidate done: it is recorded if it survives (collisions == 0) or if results.all = 1 (flags: other RESULT_ flags of the mode)*/
+
+void resultCandidate(word64 candidate, int diagonal, word64 numberTests, unsigned int collisions, int rightKey, int flags = 0){
+
+	resultRecord r;
+
+	if ((collisions > 0) && (results.all == 0))
+		return;
+	if ((results.json == NULL) && (results.binary == NULL))
+		return;
+
+	memset(&r, 0, sizeof(r));
+	r.run = results.run;
+	r.kind = RESULT_CANDIDATE;
+	r.mode = (word8)results.mode;
+	r.candidate.candidate = candidate;
+	r.candidate.tests = numberTests;
+	r.candidate.collisions = collisions;
+	r.candidate.diagonal = (word8)diagonal;
+	r.candidate.flags = (word8)(((collisions == 0) ? RESULT_SURVIVOR : 0) | (rightKey ? RESULT_RIGHT_KEY : 0) | flags);
+	resultPush(&r);
+}
+
+/*End of the sweep, after candidates candidates (less than the ones of resultBeginRun if cancelled): summary record and flush
+(the console summary is printed by the caller)*/
+
+void resultEndRun(word64 candidates, word64 survivors, int cancelled = 0){
+
+	resultRecord r;
+
+	memset(&r, 0, sizeof(r));
+	r.run = results.run;
+	r.kind = RESULT_SUMMARY;
+	r.mode = (word8)results.mode;
+	r.summary.candidates = candidates;
+	r.summary.survivors = survivors;
+	r.summary.cancelled = (unsigned int)cancelled;
+	r.summary.milliseconds = (word64)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - results.start).count();
+	resultPush(&r);
+
+	std::lock_guard<std::mutex> lock(results.lock);
+	resultFlush();
+	if (results.json != NULL)
+		fflush(results.json);
+	if (results.binary != NULL)
+		fflush(results.binary);
+}
+
+void resultClose(){
+
+	if (results.json != NULL)
+		fclose(results.json);
+	if (results.binary != NULL)
+		fclose(results.binary);
+	results.json = NULL;
+	results.binary = NULL;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**PROFILING:
+with -profile, the phases of newWay_contNumberCollisionAES and contNumberCollisionRandom are wrapped by profileBegin / profileEnd:
+- plaintext generation (storeMemory and play);
+- encryption (play -> cipher);
+- pair checking (belongToW on the 120 pairs);
+- RNG (the constants of the first collection; in the random case, the random ciphertexts with the flag loops that keep them distinct).
+The hardware counters (cycles, instructions, branch misses, L1D read misses, LLC misses - user space only) are opened by perf_event_open
+as one group, always running: at the beginning and at the end of a phase the group is read with one read(), and the difference is added
+to the phase. The report gives IPC and the counts for each test. If the counters are not available (not Linux, or not allowed by
+perf_event_paranoid), only the time of the phases is reported.
+The counters follow the calling thread only (not the threads of the pipeline): the backends of the sweeps are profiled by
+profileBackends on this thread, with the functions that a lane of the pipeline and the bitsliced multi-key sweep run.
+*/
+
+#define PROFILE_PHASES 4
+#define PROFILE_COUNTERS 5
+
+#define PROFILE_GENERATION 0
+#define PROFILE_ENCRYPTION 1
+#define PROFILE_CHECK 2
+#define PROFILE_RNG 3
+
+const char *profilePhaseName[PROFILE_PHASES] = { "plaintext generation", "encryption", "pair checking", "RNG" };
+const char *profileCounterName[PROFILE_COUNTERS] = { "cycles", "instructions", "branch misses", "L1D misses", "LLC misses" };
+
+int profiling = 0;
+int profileLeader = -1, profileIndex[PROFILE_COUNTERS], nProfileCounters = 0;
+int profileDescriptor[PROFILE_COUNTERS];/* the file descriptors of the group (the first one is profileLeader) */
+word64 profileCount[PROFILE_PHASES][PROFILE_COUNTERS], profileSnapshot[PROFILE_COUNTERS];
+double profileTime[PROFILE_PHASES];
+long long profileTests;
+std::chrono::steady_clock::time_point profileClock;
+
+/*Current values of the counters (in the order of profileCounterName, 0 if not available)*/
+
+void profileRead(word64 *value){
+
+	int i;
+	word64 buffer[1 + PROFILE_COUNTERS];
+
+	memset(value, 0, PROFILE_COUNTERS * sizeof(word64));
+#if defined(__linux__)
+	if ((profileLeader >= 0) && (read(profileLeader, buffer, sizeof(buffer)) > 0))
+	{
+		for (i = 0; i < PROFILE_COUNTERS; i++)
+		{
+			if ((profileIndex[i] >= 0) && ((word64)profileIndex[i] < buffer[0]))
+				value[i] = buffer[1 + profileIndex[i]];
+		}
+	}
+#else
+	(void)i;
+	(void)buffer;
+#endif
+}
+
+inline void profileBegin(int phase){
+
+	if (profiling == 0)
+		return;
+
+	(void)phase;
+	profileRead(profileSnapshot);
+	profileClock = std::chrono::steady_clock::now();
+}
+
+inline void profileEnd(int phase){
+
+	int i;
+	word64 value[PROFILE_COUNTERS];
+
+	if (profiling == 0)
+		return;
+
+	profileTime[phase] += std::chrono::duration<double>(std::chrono::steady_clock::now() - profileClock).count();
+	profileRead(value);
+	for (i = 0; i < PROFILE_COUNTERS; i++)
+		profileCount[phase][i] += value[i] - profileSnapshot[i];
+}
+
+void resetProfile(){
+
+	memset(profileCount, 0, sizeof(profileCount));
+	memset(profileTime, 0, sizeof(profileTime));
+	profileTests = 0;
+}
+
+/*It opens the counters: it returns the number of counters available*/
+
+int startProfiling(){
+
+	int i;
+
+	profiling = 1;
+	nProfileCounters = 0;
+	for (i = 0; i < PROFILE_COUNTERS; i++)
+		profileIndex[i] = -1;
+	resetProfile();
+
+#if defined(__linux__)
+	struct perf_event_attr attr;
+	int fd;
+	word64 type[PROFILE_COUNTERS] = { PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE };
+	word64 config[PROFILE_COUNTERS] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_BRANCH_MISSES,
+		PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), PERF_COUNT_HW_CACHE_MISSES };
+
+	for (i = 0; i < PROFILE_COUNTERS; i++)
+	{
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = (unsigned int)type[i];
+		attr.config = config[i];
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP;
+
+		fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, profileLeader, 0);
+		if (fd < 0)
+			continue;
+
+		if (profileLeader < 0)
+			profileLeader = fd;
+		profileDescriptor[nProfileCounters] = fd;
+		profileIndex[i] = nProfileCounters++;
+	}
+#endif
+
+	if (nProfileCounters == 0)
+		printf("Profiling: hardware counters not available, only the time of the phases.\n");
+
+	return nProfileCounters;
+}
+
+void stopProfiling(){
+
+	int i;
+
+#if defined(__linux__)
+	for (i = 0; i < nProfileCounters; i++)
+		close(profileDescriptor[i]);
+#else
+	(void)i;
+#endif
+	nProfileCounters = 0;
+	profileLeader = -1;
+	profiling = 0;
+}
+
+void printProfile(const char *title){
+
+	int phase, i;
+	double tests = (profileTests > 0) ? (double)profileTests : 1.0;
+
+	printf("Profile - %s: %lld tests\n", title, profileTests);
+	printf("%-22s %10s %8s", "phase", "time (s)", "IPC");
+	for (i = 2; i < PROFILE_COUNTERS; i++)
+		printf(" %15s", profileCounterName[i]);
+	printf("  (for each test)\n");
+
+	for (phase = 0; phase < PROFILE_PHASES; phase++)
+	{
+		printf("%-22s %10.3f", profilePhaseName[phase], profileTime[phase]);
+		if ((profileIndex[0] >= 0) && (profileIndex[1] >= 0) && (profileCount[phase][0] > 0))
+			printf(" %8.2f", (double)profileCount[phase][1] / profileCount[phase][0]);
+		else
+			printf(" %8s", "-");
+
+		for (i = 2; i < PROFILE_COUNTERS; i++)
+		{
+			if (profileIndex[i] >= 0)
+				printf(" %15.2f", profileCount[phase][i] / tests);
+			else
+				printf(" %15s", "-");
+		}
+		printf("\n");
+	}
+	printf("\n");
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*Suppose that p = p1 \xor p2, that is the sum of two plaintexts.
+I ask myself if it belong to a subspace D:
+0 - not belong;
+1 - belong to D (dim 12)
+*/
+
+int belongToU(word8 p[][4])
+{
+	if ((p[0][0] == 0) && (p[1][1] == 0) && (p[2][2] == 0) && (p[3][3] == 0))
+		return 1;
+
+	if ((p[1][0] == 0) && (p[2][1] == 0) && (p[3][2] == 0) && (p[0][3] == 0))
+		return 1;
+
+	if ((p[2][0] == 0) && (p[3][1] == 0) && (p[0][2] == 0) && (p[1][3] == 0))
+		return 1;
+
+	if ((p[3][0] == 0) && (p[0][1] == 0) && (p[1][2] == 0) && (p[2][3] == 0))
+		return 1;
+
+	return 0;
+
+}
+
+//Similar to the previous one, but with C instead of D,
+
+int belongToV(word8 p[][4])
+{
+	if ((p[0][0] == 0) && (p[1][0] == 0) && (p[2][0] == 0) && (p[3][0] == 0))
+		return 1;
+
+	if ((p[0][1] == 0) && (p[1][1] == 0) && (p[2][1] == 0) && (p[3][1] == 0))
+		return 1;
+
+	if ((p[0][2] == 0) && (p[1][2] == 0) && (p[2][2] == 0) && (p[3][2] == 0))
+		return 1;
+
+	if ((p[0][3] == 0) && (p[1][3] == 0) && (p[2][3] == 0) && (p[3][3] == 0))
+		return 1;
+
+	return 0;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*Suppose that p = p1 \xor p2, that is the sum of two plaintexts.
+I ask myself if it belong to a subspace M:
+0 - not belong;
+1 - belong to W (dim 12)
+*/
+
+int belongToW(word8 p[][4])
+{
+	/*Consider MC^-1(W) since no mixcolumns at the end!*/
+
+	if ((p[0][0] == 0) && (p[3][1] == 0) && (p[2][2] == 0) && (p[1][3] == 0))
+		return 1;
+
+	if ((p[1][0] == 0) && (p[0][1] == 0) && (p[3][2] == 0) && (p[2][3] == 0))
+		return 1;
+
+	if ((p[2][0] == 0) && (p[1][1] == 0) && (p[0][2] == 0) && (p[3][3] == 0))
+		return 1;
+
+	if ((p[3][0] == 0) && (p[2][1] == 0) && (p[1][2] == 0) && (p[0][3] == 0))
+		return 1;
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**ORACLE QUERIES - DATA COMPLEXITY:
+the data complexity of the distinguisher is the number of distinct chosen plaintexts, not the number of encryptions: with
+newWay_contNumberCollisionAES the constants of the test k are the same for all the candidates, so two candidates of the same test
+ask the same plaintext when their diagonals meet (the 16 diagonals of a candidate are a coset of the 16 values of storeMemory).
+The encryptions of newWay_contNumberCollisionAES and contNumberCollisionAES go through queryEncryption: if the accounting is on
+(startQueries), the plaintexts are packed in 64 bits and stored with their ciphertexts in a hash set (open addressing, linear
+probing, doubled when half full) - a repeated plaintext is served from the set, without encryption, and the counters give the
+distinct chosen plaintexts against the total queries. dataComplexity compares the two strategies on the same candidates.
+The set holds the ciphertexts of one key: a query with another key empties it (the counters go on), so a ciphertext of the old key
+is never served.
+*/
+
+/*Pack the 16 nibbles of a state (position j + 4*i, as the ciphertext of encryption) in 64 bits*/
+
+word64 packState(word8 *p){
+
+	int i;
+	word64 packed = 0;
+
+	for (i = 0; i < 16; i++)
+		packed |= ((word64)(*(p + i) & 0xf)) << (4 * i);
+
+	return packed;
+}
+
+void unpackState(word64 packed, word8 *p){
+
+	int i;
+
+	for (i = 0; i < 16; i++)
+		*(p + i) = (word8)((packed >> (4 * i)) & 0xf);
+}
+
+typedef struct{
+	word64 *plaintext, *ciphertext;
+	word8 *used;
+	int logSize;/* 2^logSize entries */
+	word64 key;/* packed key of the ciphertexts in the set */
+	long long stored;/* entries in the set */
+	long long distinct, queries;
+} querySet;
+
+querySet queries = { NULL, NULL, NULL, 0, 0, 0, 0, 0 };
+
+inline word64 queryHash(word64 plaintext){
+
+	return (plaintext * 0x9E3779B97F4A7C15ULL) >> (64 - queries.logSize);
+}
+
+void stopQueries(){
+
+	free(queries.plaintext);
+	free(queries.ciphertext);
+	free(queries.used);
+	queries.plaintext = NULL;
+	queries.ciphertext = NULL;
+	queries.used = NULL;
+	queries.logSize = 0;
+}
+
+/*Empty set of 2^logSize entries: it returns 0 if OK*/
+
+int startQueries(int logSize){
+
+	stopQueries();
+
+	queries.plaintext = (word64 *)malloc(sizeof(word64) << logSize);
+	queries.ciphertext = (word64 *)malloc(sizeof(word64) << logSize);
+	queries.used = (word8 *)calloc((size_t)1 << logSize, 1);
+	if ((queries.plaintext == NULL) || (queries.ciphertext == NULL) || (queries.used == NULL))
+	{
+		printf("Not enough memory for the set of the queries (2^%d entries)\n", logSize);
+		stopQueries();
+		return 1;
+	}
+
+	queries.logSize = logSize;
+	queries.key = 0;
+	queries.stored = 0;
+	queries.distinct = 0;
+	queries.queries = 0;
+
+	return 0;
+}
+
+void queryInsert(word64 plaintext, word64 ciphertext){
+
+	word64 h, mask = ((word64)1 << queries.logSize) - 1;
+
+	for (h = queryHash(plaintext); queries.used[h]; h = (h + 1) & mask);
+
+	queries.used[h] = 1;
+	queries.plaintext[h] = plaintext;
+	queries.ciphertext[h] = ciphertext;
+}
+
+/*Double the set: if there is not enough memory, the accounting stops (the distinct plaintexts counted up to now are kept)*/
+
+void queryGrow(){
+
+	word64 *plaintext = queries.plaintext, *ciphertext = queries.ciphertext, key = queries.key;
+	word8 *used = queries.used;
+	long long distinct = queries.distinct, total = queries.queries, stored = queries.stored, h, size = 1LL << queries.logSize;
+
+	queries.plaintext = NULL;
+	queries.ciphertext = NULL;
+	queries.used = NULL;
+
+	if (startQueries(queries.logSize + 1) == 0)
+	{
+		for (h = 0; h < size; h++)
+		{
+			if (used[h])
+				queryInsert(plaintext[h], ciphertext[h]);
+		}
+		queries.key = key;
+		queries.stored = stored;
+	}
+	queries.distinct = distinct;
+	queries.queries = total;
+
+	free(plaintext);
+	free(ciphertext);
+	free(used);
+}
+
+/*encryption of the distinguisher: with the accounting on, a plaintext already asked is not encrypted again*/
+
+void queryEncryption(word8 plaintext[][4], word8 key[][4], word8 *ciphertext){
+
+	word64 packed, packedKey, h, mask;
+
+	if (queries.used == NULL)
+	{
+		encryption(plaintext, key, ciphertext);
+		return;
+	}
+
+	queries.queries++;
+	packed = packState(&(plaintext[0][0]));
+	mask = ((word64)1 << queries.logSize) - 1;
+
+	//another key: the ciphertexts in the set are not valid
+	packedKey = packState(&(key[0][0]));
+	if ((queries.stored > 0) && (packedKey != queries.key))
+	{
+		memset(queries.used, 0, (size_t)1 << queries.logSize);
+		queries.stored = 0;
+	}
+	queries.key = packedKey;
+
+	for (h = queryHash(packed); queries.used[h]; h = (h + 1) & mask)
+	{
+		if (queries.plaintext[h] == packed)
+		{
+			unpackState(queries.ciphertext[h], ciphertext);
+			return;
+		}
+	}
+
+	encryption(plaintext, key, ciphertext);
+
+	queries.used[h] = 1;
+	queries.plaintext[h] = packed;
+	queries.ciphertext[h] = packState(ciphertext);
+	queries.stored++;
+	queries.distinct++;
+
+	if (2 * queries.stored > (1LL << queries.logSize))
+		queryGrow();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**AES CASE:
+for a fixed combination of delta0, delta1, delta2, delta3, it generates the corresponding collection, that is sets of plaintexts
+W_\Delta and the corresponding ciphertexts.
+Then it counts the number of collision in M.
+
+It returns 1 if there is at least one collision; 0 otherwise.
+In this last cast, it prints the possible right key.*/
+
+/*
+New way to generate plaintexts so as to use fewer plaintexts to distinguish the AES permutation from the random permutation
+We can view a column of size 2^4=16 as a unit.
+For the 2^4*4=2^16 different collections,each of them has about 2^11.7 columns.
+The nibbles in the same column whose position are (0,1),(0,2),(0,3),(1,0),(1,2),(1,3),(2,0),(2,1),(2,3),(3,0),(3,1),(3,2) are same.
+Therefore,it is neccessary to store the values at each column whose position are (0,1),(0,2),(0,3),(1,0),(1,2),(1,3),(2,0),(2,1),(2,3),(3,0),(3,1),(3,2) at the first row.
+These 12 values of each test are not stored: testConstants computes them from the seed of the run, by chunks (see TEST CONSTANTS).
+*/
+
+long int numberTestsDone;/* tests executed by the last call of newWay_contNumberCollisionAES or contNumberCollisionRandom */
+int numberCollisionsDone;/* pairs with a collision in the last test of that call (0 if the candidate survives) */
+
+/*Pairs of the nTexts ciphertexts of a test with a collision (belongToW)*/
+
+int collisionCount(word8 ciphertexts[][16], int nTexts){
+
+	int i, j, t, s, n = 0;
+	word8 temp3[4][4];
+
+	for (i = 0; i<nTexts; i++)
+	{
+		for (j = i + 1; j<nTexts; j++)
+		{
+			for (t = 0; t<4; t++)
+			{
+				for (s = 0; s<4; s++)
+					temp3[s][t] = ciphertexts[i][s + 4 * t] ^ ciphertexts[j][s + 4 * t];
+			}
+
+			n += (belongToW(temp3) > 0);
+		}
+	}
+
+	return n;
+}
+
+int newWay_contNumberCollisionAES(word8 k1, word8 k2, word8 k3, word8 k4, word8 key[][4], int number)/* use number to check whether it is the first collection */
+{
+	int i, j, numberCollision, t, s;
+	word8 storeMemory[16][4], v[4], temp2[16], temp3[4][4];
+	///
+	/*define temp as a two-dimensional array of size 4*4 instead of an one-dimensional array of size 16 */
+	///
+	word8 temp[4][4];
+
+	long int k;
+
+	//preparation plaintexts
+	profileBegin(PROFILE_GENERATION);
+	for (j = 0; j<16; j++)
+	{
+		v[0] = (word8)j;
+		v[1] = 0x0;
+		v[2] = 0x0;
+		v[3] = 0x0;
+
+		partialInvMixColumn(&(v[0]));
+
+		for (i = 0; i<4; i++)
+		{
+			storeMemory[j][i] = inverseByteTransformation(v[i]);
+		}
+
+		storeMemory[j][0] ^= k1;/* StoreMemory is used to store the pre-computed values.It is of size 16*4 since there are 16 different values of v[0] and we need four nibbles one time */
+		storeMemory[j][1] ^= k2;
+		storeMemory[j][2] ^= k3;
+		storeMemory[j][3] ^= k4;
+
+	}
+
+	profileEnd(PROFILE_GENERATION);
+
+	/*If it is the first collection,store the values of the 12 nibbles of each column*/
+	if (number == 1)
+	{
+		profileBegin(PROFILE_RNG);
+		newConstants(4);
+		profileEnd(PROFILE_RNG);
+	}
+
+	for (k = 0; k<N_TEST; k++)//We need about 2^11.7 tests
+	{
+		//plaintexts
+		profileBegin(PROFILE_GENERATION);
+		int index[12] = { 1, 2, 3, 4, 6, 7, 8, 9, 11, 12, 13, 14 };
+		word8 testConstant[12];
+		testConstants(k, testConstant);
+		for (int j = 0; j < 16; j++){
+			for (int i = 0; i < 12; i++){
+				play[j][index[i]] = testConstant[i];
+			}
+		}
+
+		for (j = 0; j<16; j++)
+		{
+			play[j][0] = storeMemory[j][0];
+			play[j][5] = storeMemory[j][1];
+			play[j][10] = storeMemory[j][2];
+			play[j][15] = storeMemory[j][3];
+		}
+
+		/*print the plaintexts*/
+		/*for (int i = 0; i < 16; i++){
+			for (int j = 0; j < 16; j++){
+				printf("0x%x ", play[i][j]);
+			}
+			printf("\n");
+		}
+
+		system("pause");*/
+
+		/* After the above operation,we can get 16 different states of plaintexts,stored in the two-dimensional array play of size 16*16 */
+		profileEnd(PROFILE_GENERATION);
+
+		//ciphertexts
+		profileBegin(PROFILE_ENCRYPTION);
+		for (j = 0; j<16; j++)
+		{
+			for (i = 0; i<16; i++)
+			{
+				/////
+				/* orignal temp[i]=play[j][i]:*/
+				////
+				temp[i / 4][i % 4] = play[j][i];/* get the first state of plaintext */
+			}
+			queryEncryption(temp, key, &(temp2[0]));/* encrypt the first state */
+			for (i = 0; i<16; i++)
+			{
+				cipher[j][i] = temp2[i];/* get the corresponding cipher */
+			}
+		}
+
+		/* After the above operation,we can get 16 ciphers corresponding to the pre-computed random plaintexts */
+		profileEnd(PROFILE_ENCRYPTION);
+
+		profileBegin(PROFILE_CHECK);
+		for (i = 0; i<16; i++)
+		{
+			for (j = i + 1; j<16; j++)//To generate pairs
+			{
+				for (t = 0; t<4; t++)
+				{
+					for (s = 0; s<4; s++)
+					{
+						temp3[s][t] = cipher[i][s + 4 * t] ^ cipher[j][s + 4 * t];
+					}
+				}
+
+				numberCollision = belongToW(temp3);
+
+				if (numberCollision > 0)
+				{
+					profileEnd(PROFILE_CHECK);
+					telemetryCandidate(k + 1, 16, 0);
+					numberTestsDone = k + 1;
+					numberCollisionsDone = collisionCount(cipher, 16);
+					return 1;
+				}
+
+			}
+		}
+		profileEnd(PROFILE_CHECK);
+	}
+
+	telemetryCandidate(N_TEST, 16, 1);
+	numberTestsDone = N_TEST;
+	numberCollisionsDone = 0;
+	return 0;
+}
+
+int contNumberCollisionAES(word8 k1, word8 k2, word8 k3, word8 k4, word8 key[][4])
+{
+	int i, j, numberCollision, t, s;
+	word8 storeMemory[16][4], v[4], temp2[16], temp3[4][4];
+	///
+	/*define temp as a two-dimensional array of size 4*4 instead of an one-dimensional array of size 16 */
+	///
+	word8 temp[4][4];
+
+	long int k;
+
+	//prepare the plaintexts
+	for (j = 0; j<16; j++)
+	{
+		v[0] = (word8)j;
+		v[1] = 0x0;
+		v[2] = 0x0;
+		v[3] = 0x0;
+
+		partialInvMixColumn(&(v[0]));
+
+		for (i = 0; i<4; i++)
+		{
+			storeMemory[j][i] = inverseByteTransformation(v[i]);
+		}
+
+		storeMemory[j][0] ^= k1;/* StoreMemory is used to store the pre-computed values.It is of size 16*4 since there are 16 different values of v[0] and we need four nibbles one time */
+		storeMemory[j][1] ^= k2;
+		storeMemory[j][2] ^= k3;
+		storeMemory[j][3] ^= k4;
+
+	}
+
+	for (k = 0; k<N_TEST; k++)//We need about 2^11.7 tests
+	{
+		//plaintexts
+		for (j = 0; j<16; j++)
+		{
+			play[0][j] = randomByte();
+
+			for (i = 1; i<16; i++)
+			{
+				play[i][j] = play[0][j];
+			}
+		}
+		for (j = 0; j<16; j++)
+		{
+			play[j][0] = storeMemory[j][0];
+			play[j][5] = storeMemory[j][1];
+			play[j][10] = storeMemory[j][2];
+			play[j][15] = storeMemory[j][3];
+		}
+		/* After the above operation,we can get 16 different states of plaintexts,stored in the two-dimensional array play of size 16*16 */
+
+		//ciphertexts
+		for (j = 0; j<16; j++)
+		{
+			for (i = 0; i<16; i++)
+			{
+				/////
+				/* orignal temp[i]=play[j][i]:*/
+				////
+				temp[i / 4][i % 4] = play[j][i];/* get the first state of plaintext */
+			}
+			queryEncryption(temp, key, &(temp2[0]));/* encrypt the first state */
+			for (i = 0; i<16; i++)
+			{
+				cipher[j][i] = temp2[i];/* get the corresponding cipher */
+			}
+		}
+		/* After the above operation,we can get 16 ciphers corresponding to the pre-computed random plaintexts */
+
+		for (i = 0; i<16; i++)
+		{
+			for (j = i + 1; j<16; j++)//To generate pairs
+			{
+				for (t = 0; t<4; t++)
+				{
+					for (s = 0; s<4; s++)
+					{
+						temp3[s][t] = cipher[i][s + 4 * t] ^ cipher[j][s + 4 * t];
+					}
+				}
+
+				numberCollision = belongToW(temp3);
+
+				if (numberCollision > 0)
+					return 1;
+
+			}
+		}
+	}
+
+	return 0;
+
+}
+
+/**RANDOM PERMUTATION CASE:
+for a fixed combination of delta0, delta1, delta2, delta3, it generates the corresponding collection, that is sets of plaintexts
+W_\Delta and the corresponding ciphertexts.
+For simplicity, the ciphertexts are generated in a random way.
+Then it counts the number of collision in M.
+
+It returns 1 if there is at least one collision; 0 otherwise.*/
+
+int contNumberCollisionRandom()
+{
+	word8 temp3[4][4], temp[4][4];
+
+	long int i;
+
+	int l, k, j, t, s, numberCollision;
+	int flag2, flag;
+
+	for (i = 0; i<N_TEST; i++)
+	{
+		//produce random ciphertexts - it is a random Permutation!
+		profileBegin(PROFILE_RNG);
+		for (j = 0; j<16; j++)// procedure a two-dimensional array cipher[16][16],assigned with random value and each row differs from each other.
+		{
+			do
+			{
+				flag2 = 0;
+
+				//get 16 elements,assigned to temp
+				for (k = 0; k<4; k++)
+				{
+					for (l = 0; l<4; l++)
+						temp[l][k] = randomByte();//assign random values to temp[4][4]
+				}
+
+
+				for (t = 0; ((t<j) && (j>0)); t++)
+				{
+					flag = 0;
+					for (k = 0; k<4; k++)
+					{
+						for (l = 0; l<4; l++)
+						{
+							if (temp[l][k] == cipher[t][l + 4 * k])//cipher is a two-dimensional array of size 16*16
+								flag++;
+						}
+					}
+
+					if (flag == 16)
+						flag2 = 1;
+
+				}
+
+				if (flag2 == 0)//The 16 elements in temp[4][4] has not been contained in any row of the cipher[0-(j-1)][16]
+				{
+					for (k = 0; k<4; k++)
+					{
+						for (l = 0; l<4; l++)
+						{
+							cipher[j][l + 4 * k] = temp[l][k];//assign the 16 values in temp[4][4] to the j-th row of cipher
+						}
+					}
+				}
+			} while (flag2 == 1);
+		}
+		profileEnd(PROFILE_RNG);
+
+		profileBegin(PROFILE_CHECK);
+		for (l = 0; l<16; l++)
+		{
+			for (j = l + 1; j<16; j++)
+			{
+				for (t = 0; t<4; t++)
+				{
+					for (s = 0; s<4; s++)
+					{
+						temp3[s][t] = cipher[l][s + 4 * t] ^ cipher[j][s + 4 * t];
+					}
+				}
+
+				numberCollision = belongToW(temp3);
+
+				if (numberCollision > 0)
+				{
+					profileEnd(PROFILE_CHECK);
+					telemetryCandidate(i + 1, 0, 0);
+					numberTestsDone = i + 1;
+					numberCollisionsDone = collisionCount(cipher, 16);
+					return 1;
+				}
+
+			}
+		}
+		profileEnd(PROFILE_CHECK);
+	}
+
+	telemetryCandidate(N_TEST, 0, 1);
+	numberTestsDone = N_TEST;
+	numberCollisionsDone = 0;
+	return 0;
+
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+The following function implements the distinguisher for 5 rounds.
+In particular, if var = 0, it generates the set of plaintexts-ciphertexts using the AES mode, and checks that it is AES.
+If var = 1, it generates the set of plaintexts-ciphertexts using the random mode, and checks that it is a random permutation.
+*/
+int distinguisher5Rounds(word8 key[][4], int var)
+{
+	int k1, k2, k3, k4, number, nnn, right;
+	word8 kk1, kk2, kk3, kk4;
+	bool first = true;
+
+	nnn = 0;
+	resetTelemetry(N_CANDIDATES);
+	resultBeginRun((var == 0) ? RESULT_AES : RESULT_RANDOM, 4, 0, 0, N_CANDIDATES);
+
+	for (k1 = 0; k1<16; k1++)
+	{
+		//printf("%d\n", k1);
+		kk1 = (word8)k1;
+		for (k2 = 0; k2 <16; k2++)
+		{
+			kk2 = (word8)k2;
+			for (k3 = 0; k3<16; k3++)
+			{
+				kk3 = (word8)k3;
+				for (k4 = 0; k4 <16; k4++)
+				{
+					kk4 = (word8)k4;
+
+					/*if (var == 0)
+						number = contNumberCollisionAES(kk1, kk2, kk3, kk4, key);// for each 4 diffrent nibbles of key,check whether it is true or not*/
+
+					//////
+					/* use different strategy since we use different ways to choose plaintexts */
+					//////
+					if (var == 0)
+					{
+						if (first)
+						{
+							number = newWay_contNumberCollisionAES(kk1, kk2, kk3, kk4, key, 1);// for each 4 diffrent nibbles of key,check whether it is true or not
+							first = false;
+						}
+						else
+							number = newWay_contNumberCollisionAES(kk1, kk2, kk3, kk4, key, 0);// for each 4 diffrent nibbles of key,check whether it is true or not
+					}
+					///
+					/* END */
+					///
+
+					else
+						number = contNumberCollisionRandom();
+
+					right = ((k1 == key[0][0]) && (k2 == key[1][1]) && (k3 == key[2][2]) && (k4 == key[3][3]));
+					resultCandidate((k1 << 12) | (k2 << 8) | (k3 << 4) | k4, 0, numberTestsDone, (number == 0) ? 0 : numberCollisionsDone, right);
+
+					if ((number == 0) && (results.console == 1))
+					{
+						printf("0x%x - 0x%x - 0x%x - 0x%x", k1, k2, k3, k4);
+						if (right)
+							printf(" - Right Key!\n");
+						else
+							printf(" - Wrong Key!\n");
+					}
+					if (number == 0)
+						nnn++;
+				}
+			}
+		}
+	}
+
+	printf("Survivors: %d of %d candidates\n", nnn, N_CANDIDATES);
+	resultEndRun(N_CANDIDATES, nnn);
+
+	if (nnn > 0)
+		return 0;
+	else
+		return 1;
+}
+
+/*Profile (see PROFILING) of the first nCandidates candidates of distinguisher5Rounds, in the AES and in the random case*/
+
+void profileDistinguisher(word8 key[][4], int nCandidates)
+{
+	int c, var;
+
+	startProfiling();
+
+	for (var = 0; var < 2; var++)
+	{
+		resetProfile();
+
+		for (c = 0; c < nCandidates; c++)
+		{
+			if (var == 0)
+				newWay_contNumberCollisionAES((word8)(c >> 12), (word8)((c >> 8) & 0xf), (word8)((c >> 4) & 0xf), (word8)(c & 0xf), key, c == 0);
+			else
+				contNumberCollisionRandom();
+			profileTests += numberTestsDone;
+		}
+
+		printProfile((var == 0) ? "AES (newWay_contNumberCollisionAES)" : "random permutation (contNumberCollisionRandom)");
+	}
+
+	stopProfiling();
+}
+
+/*Data complexity (see ORACLE QUERIES) of nCandidates candidates of distinguisher5Rounds, with the shared constants of
+newWay_contNumberCollisionAES and with the new random plaintexts of each test of contNumberCollisionAES.
+The candidates are taken in a random order (the same for the two strategies), not the first ones: two candidates share plaintexts
+only if their difference is storeMemory[j] ^ storeMemory[j'], that has all the nibbles != 0, so a range with a fixed k1 has no repeats*/
+
+void dataComplexity(word8 key[][4], int nCandidates)
+{
+	int c, i, t, strategy, survivors, *order;
+	word8 k1, k2, k3, k4;
+	const char *strategyName[2] = { "newWay_contNumberCollisionAES", "contNumberCollisionAES" };
+	std::chrono::steady_clock::time_point start;
+
+	order = (int *)malloc(N_CANDIDATES * sizeof(int));
+	for (i = 0; i < N_CANDIDATES; i++)
+		order[i] = i;
+	for (i = N_CANDIDATES - 1; i > 0; i--)
+	{
+		c = (int)(genrand_int32() % (i + 1));
+		t = order[i];
+		order[i] = order[c];
+		order[c] = t;
+	}
+
+	printf("Data complexity on %d candidates:\n", nCandidates);
+	printf("%-30s %10s %14s %14s %8s %10s %10s\n", "strategy", "survivors", "encryptions", "distinct", "log2", "repeats", "time (s)");
+
+	for (strategy = 0; strategy < 2; strategy++)
+	{
+		if (startQueries(20) != 0)
+			break;
+
+		survivors = 0;
+		start = std::chrono::steady_clock::now();
+		for (i = 0; i < nCandidates; i++)
+		{
+			c = order[i];
+			k1 = (word8)(c >> 12);
+			k2 = (word8)((c >> 8) & 0xf);
+			k3 = (word8)((c >> 4) & 0xf);
+			k4 = (word8)(c & 0xf);
+
+			if (strategy == 0)
+				survivors += (newWay_contNumberCollisionAES(k1, k2, k3, k4, key, i == 0) == 0);
+			else
+				survivors += (contNumberCollisionAES(k1, k2, k3, k4, key) == 0);
+		}
+
+		printf("%-30s %10d %14lld %14lld %8.2f %9.2f%% %10.2f%s\n", strategyName[strategy], survivors, queries.queries, queries.distinct,
+			(queries.distinct > 0) ? log2((double)queries.distinct) : 0.0,
+			(queries.queries > 0) ? 100.0 * (queries.queries - queries.distinct) / queries.queries : 0.0,
+			std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(),
+			(queries.used == NULL) ? " (accounting stopped: memory)" : "");
+	}
+
+	stopQueries();
+	free(order);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**CIPHER OF THE DISTINGUISHER:
+the pipelined distinguisher does not depend on the size of the cells. selectCipher(4) selects the small scale AES (encryption,
+nibbles, 2^4 texts for each set), selectCipher(8) the full AES (encryptionAES8, bytes, 2^8 texts for each set).
+The full AES is only in the pipeline (aes5Run, -byte -pipeline): the serial drivers (distinguisher5Rounds, fullKeyRecovery, the
+random case, the cache and the bitsliced encryption) are written for nibbles and stay on the small scale AES.
+For a wrong candidate of the full AES a test (256 texts, 32640 pairs) has a collision with probability about 32640 * 4 * 2^-32 = 2^-15:
+N_TEST tests eliminate about 12% of the wrong candidates, and aes5Run refuses a byte run whose budget cannot separate the candidates
+(see budgetSeparates) - a whole sweep needs about 730000 tests.
+*/
+
+#define MAX_CELL_VALUES 256
+
+int cellBits = 4, cellValues = 16;
+void (*encryptionCell)(word8 initialMessage[][4], word8 initialKey[][4], word8 *ciphertext) = encryptionFused;
+word8 (*inverseCellTransformation)(word8 byte) = inverseByteTransformation;
+void (*partialInvMixColumnCell)(word8 *p) = partialInvMixColumn;
+
+void selectCipher(int bits){
+
+	cellBits = bits;
+	cellValues = 1 << bits;
+
+	static int aes8Ready = 0;
+
+	if (bits == 8){
+		if (aes8Ready == 0)
+			initializationAES8();
+		aes8Ready = 1;
+		encryptionCell = encryptionAES8;
+		inverseCellTransformation = inverseByteTransformationAES8;
+		partialInvMixColumnCell = partialInvMixColumnAES8;
+	}
+	else{
+		encryptionCell = encryptionFused;
+		inverseCellTransformation = inverseByteTransformation;
+		partialInvMixColumnCell = partialInvMixColumn;
+	}
+}
+
+/**Generate a random cell (for nibbles, the same as randomByte)*/
+word8 randomCell(){
+
+	int a = genrand_int31();
+
+	a = a % cellValues;
+
+	return (word8)a;
+}
+
+/*Cell i (0 - 3) of a candidate: the candidates (k1, k2, k3, k4) are packed as k1<<3*cellBits | k2<<2*cellBits | k3<<cellBits | k4*/
+
+word8 candidateCell(long long candidate, int i){
+
+	return (word8)((candidate >> (cellBits * (3 - i))) & (cellValues - 1));
+}
+
+/*Generate the constants of the tests (they are the same for all the candidates, see TEST CONSTANTS)*/
+
+void generateConstants(){
+
+	newConstants(cellBits);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**CIPHERTEXT CACHE:
+for a fixed key and seed, the plaintexts of the test k are its constants (out of the diagonal, see TEST CONSTANTS) and one of the 2^16 values of the
+diagonal, so the whole material of a sweep is N_TEST blocks of 2^16 packed ciphertexts (position = value of the diagonal, k1 in the
+most significant nibble), 512 KB for each test - the 16 texts of a candidate are 16 entries of the block.
+The cache is a file (small scale AES only): a header of CACHE_HEADER_SIZE bytes (cacheHeader) and then the blocks in the order of
+the tests. It is built incrementally by cacheBuild - test by test, the header counts the complete blocks - and read by mmap: the
+generators of the pipeline take the ciphertexts of the tests k < cacheTests from it, and encrypt only the other ones.
+The header stores key, seed, N_Round, N_TEST and a hash of S-box and matrix: a cache is used only if all of them match.
+The complete blocks are also checked against the length of the file (a copy or a disk that stopped in the middle): the tests past
+the end of the file are built again, and never mapped.
+*/
+
+#define CACHE_HEADER_SIZE 4096
+#define CACHE_BLOCK (N_CANDIDATES * sizeof(word64))
+
+typedef struct{
+	char magic[8];
+	word64 key, seed, spn;
+	int nRound, nTest;
+	word64 built;/* complete blocks (tests 0 - built-1) */
+} cacheHeader;
+
+cacheHeader cacheInfo;
+const word64 *cacheMap = NULL;
+size_t cacheSize = 0;
+long int cacheTests = 0;/* tests that the pipeline takes from the cache (0 = no cache) */
+
+/*Hash (FNV-1a) of S-box and MixColumns matrix*/
+
+word64 spnHash(){
+
+	int i;
+	word64 h = 0xcbf29ce484222325ULL;
+
+	for (i = 0; i < 16; i++)
+		h = (h ^ sBox[i]) * 0x100000001b3ULL;
+	for (i = 0; i < 16; i++)
+		h = (h ^ mixMatrix[i / 4][i % 4]) * 0x100000001b3ULL;
+
+	return h;
+}
+
+/*Same as encryptTest, but the ciphertexts are read in the block of the test k*/
+
+void cachedTest(word8 storeMemory[][4], long int k, word8 ciphertexts[][16]){
+
+	int j;
+	const word64 *block = cacheMap + (CACHE_HEADER_SIZE / sizeof(word64)) + k * N_CANDIDATES;
+
+	for (j = 0; j < 16; j++)
+		unpackState(block[(storeMemory[j][0] << 12) | (storeMemory[j][1] << 8) | (storeMemory[j][2] << 4) | storeMemory[j][3]], &(ciphertexts[j][0]));
+}
+
+/*Ciphertexts of the diagonal values [first, last) of the test k*/
+
+void cacheBuildPart(word8 key[][4], long int k, int first, int last, word64 *block){
+
+	int diag, l, n, position;
+	word8 temp[4][4], temp2[16], testConstant[12];
+
+	testConstants(k, testConstant);
+	n = 0;
+	for (position = 0; position < 16; position++)
+	{
+		if ((position % 4) != (position / 4))
+			temp[position / 4][position % 4] = testConstant[n++];
+	}
+
+	for (diag = first; diag < last; diag++)
+	{
+		for (l = 0; l < 4; l++)
+			temp[l][l] = (word8)((diag >> (12 - 4 * l)) & 0xf);
+
+		encryptionCell(temp, key, &(temp2[0]));
+		block[diag] = packState(&(temp2[0]));
+	}
+}
+
+void cacheClose(){
+
+#if defined(__unix__) || defined(__APPLE__)
+	if (cacheMap != NULL)
+		munmap((void *)cacheMap, cacheSize);
+#endif
+	cacheMap = NULL;
+	cacheTests = 0;
+}
+
+/*Open (or create) the cache fileName and extend it to numberTests tests, with the secret key and the constants of seed,
+on nThreads threads. Then it is mapped in memory. It returns 0 if OK*/
+
+int cacheBuild(const char *fileName, word8 key[][4], unsigned long seed, long int numberTests, int nThreads){
+
+#if defined(__unix__) || defined(__APPLE__)
+	int fd, i;
+	long int k;
+	cacheHeader header;
+	word64 *block, complete;
+	std::thread *worker;
+	struct stat status;
+
+	cacheClose();
+
+	if ((cellBits != 4) || (numberTests > N_TEST))
+	{
+		printf("Cache: only small scale AES, at most %d tests.\n", N_TEST);
+		return 1;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "AES5CCH2", 8);
+	header.key = packState(&(key[0][0]));
+	header.seed = seed;
+	header.spn = spnHash();
+	header.nRound = N_Round;
+	header.nTest = N_TEST;
+
+	fd = open(fileName, O_RDWR | O_CREAT, 0644);
+	if (fd < 0)
+	{
+		printf("Cannot open %s.\n", fileName);
+		return 1;
+	}
+
+	if (pread(fd, &cacheInfo, sizeof(cacheInfo), 0) == (ssize_t)sizeof(cacheInfo))
+	{
+		if ((memcmp(cacheInfo.magic, header.magic, 8) != 0) || (cacheInfo.key != header.key) || (cacheInfo.seed != header.seed) ||
+			(cacheInfo.spn != header.spn) || (cacheInfo.nRound != header.nRound) || (cacheInfo.nTest != header.nTest))
+		{
+			printf("Cache: %s was built for another key, seed, cipher or N_TEST.\n", fileName);
+			close(fd);
+			return 1;
+		}
+
+		//the blocks counted by the header must be in the file
+		if (fstat(fd, &status) != 0)
+		{
+			close(fd);
+			return 1;
+		}
+		complete = (status.st_size > CACHE_HEADER_SIZE) ? (word64)(status.st_size - CACHE_HEADER_SIZE) / CACHE_BLOCK : 0;
+		if (cacheInfo.built > complete)
+		{
+			printf("Cache: %s has only %llu complete tests of %llu.\n", fileName, complete, cacheInfo.built);
+			cacheInfo.built = complete;
+			if (pwrite(fd, &cacheInfo, sizeof(cacheInfo), 0) != (ssize_t)sizeof(cacheInfo))
+			{
+				close(fd);
+				return 1;
+			}
+		}
+	}
+	else
+	{
+		cacheInfo = header;
+		if (pwrite(fd, &cacheInfo, sizeof(cacheInfo), 0) != (ssize_t)sizeof(cacheInfo))
+		{
+			close(fd);
+			return 1;
+		}
+	}
+
+	if ((long int)cacheInfo.built < numberTests)
+	{
+		init_genrand(seed);
+		generateConstants();
+
+		block = (word64 *)malloc(CACHE_BLOCK);
+		worker = new std::thread[nThreads];
+
+		for (k = (long int)cacheInfo.built; k < numberTests; k++)
+		{
+			for (i = 0; i < nThreads; i++)
+				worker[i] = std::thread(cacheBuildPart, key, k, (int)(((long long)N_CANDIDATES * i) / nThreads), (int)(((long long)N_CANDIDATES * (i + 1)) / nThreads), block);
+			for (i = 0; i < nThreads; i++)
+				worker[i].join();
+
+			//first the block, then the header: an interrupted build loses at most one test
+			if (pwrite(fd, block, CACHE_BLOCK, CACHE_HEADER_SIZE + k * CACHE_BLOCK) != (ssize_t)CACHE_BLOCK)
+				break;
+			cacheInfo.built = k + 1;
+			pwrite(fd, &cacheInfo, sizeof(cacheInfo), 0);
+			telemetry.encryptions.fetch_add(N_CANDIDATES, std::memory_order_relaxed);
+		}
+
+		delete[] worker;
+		free(block);
+	}
+
+	cacheSize = CACHE_HEADER_SIZE + cacheInfo.built * CACHE_BLOCK;
+	cacheMap = (const word64 *)mmap(NULL, cacheSize, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (cacheMap == (const word64 *)MAP_FAILED)
+	{
+		cacheMap = NULL;
+		printf("Cache: cannot map %s.\n", fileName);
+		return 1;
+	}
+
+	return 0;
+#else
+	printf("Cache: not supported on this system.\n");
+	return 1;
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**PIPELINED DISTINGUISHER:
+the generation of the plaintexts and their encryption are overlapped with the search of the collisions.
+Each lane has one generator thread and one checker thread, that communicate by a lock-free single-producer/single-consumer
+ring buffer of ciphertext batches (one batch = the ciphertexts of a test).
+If the ring is full, the generator waits (backpressure).
+When the checker finds a collision, it cancels the candidate, and the generator stops encrypting for it and moves to the next one.
+The candidates in [firstCandidate, lastCandidate) are distributed among the lanes.
+*/
+
+#define PIPELINE_RING_SIZE 64 /* must be a power of 2 */
+
+typedef struct{
+	long long candidate;
+	int last;/* 1 if it is the last test (testBudget-1) of the candidate */
+	int collisionForm;/* 1 if cipher has the states of encryptionCollision instead of the ciphertexts */
+	word8 (*cipher)[16];/* cellValues ciphertexts, in the memory of the ring */
+} pipelineBatch;
+
+typedef struct{
+	pipelineBatch slot[PIPELINE_RING_SIZE];
+	word8 (*cipherMemory)[16];/* PIPELINE_RING_SIZE * cellValues ciphertexts: 256 B for each slot in the small scale AES, 4 KB in the AES */
+	std::atomic<unsigned long> head;/* next batch to read (checker) */
+	std::atomic<unsigned long> tail;/* next batch to write (generator) */
+	std::atomic<long long> cancelled;/* last candidate eliminated by the checker */
+	std::atomic<int> done;/* the generator has no more candidates */
+} pipelineRing;
+
+std::atomic<long long> nextCandidate;
+long long lastCandidate;
+
+#define PIPELINE_MAX_SURVIVORS (1 << 20)/* survivors of a sweep kept in memory: the others are only counted (and in the result sink) */
+
+std::mutex survivorMutex;
+long long *survivor;
+long long nSurvivor, nStoredSurvivor, maxSurvivor;/* survivors, survivors in survivor[], size of survivor[] */
+long long rightCandidate;/* the candidate of the main diagonal of the key, only for the results (-1 if unknown) */
+std::atomic<int> lanesRunning;
+
+word8 secretKey[4][4];/* see aes5SetKey */
+aes5Oracle oracle = NULL;/* see aes5SetOracle */
+void *oracleContext = NULL;
+aes5Oracle decryptionOracle = NULL;/* see aes5SetDecryptionOracle */
+void *decryptionOracleContext = NULL;
+
+/*Pre-computed values of the diagonal for the candidate (k1, k2, k3, k4) - as in newWay_contNumberCollisionAES*/
+
+void prepareStoreMemory(word8 k1, word8 k2, word8 k3, word8 k4, word8 storeMemory[][4]){
+
+	int i, j;
+	word8 v[4];
+
+	for (j = 0; j<cellValues; j++)
+	{
+		v[0] = (word8)j;
+		v[1] = 0x0;
+		v[2] = 0x0;
+		v[3] = 0x0;
+
+		partialInvMixColumnCell(&(v[0]));
+
+		for (i = 0; i<4; i++)
+		{
+			storeMemory[j][i] = inverseCellTransformation(v[i]);
+		}
+
+		storeMemory[j][0] ^= k1;
+		storeMemory[j][1] ^= k2;
+		storeMemory[j][2] ^= k3;
+		storeMemory[j][3] ^= k4;
+	}
+}
+
+/*Plaintexts and ciphertexts of the k-th test, on local buffers (no use of play and cipher)*/
+
+void encryptTest(word8 storeMemory[][4], long int k, word8 key[][4], word8 ciphertexts[][16]){
+
+	int i, j;
+	word8 temp[4][4], testConstant[12];
+	int index[12] = { 1, 2, 3, 4, 6, 7, 8, 9, 11, 12, 13, 14 };
+
+	testConstants(k, testConstant);
+	for (j = 0; j<cellValues; j++)
+	{
+		for (i = 0; i < 12; i++)
+			temp[index[i] / 4][index[i] % 4] = testConstant[i];
+
+		temp[0][0] = storeMemory[j][0];
+		temp[1][1] = storeMemory[j][1];
+		temp[2][2] = storeMemory[j][2];
+		temp[3][3] = storeMemory[j][3];
+
+		if (oracle != NULL)
+			oracle(temp, &(ciphertexts[j][0]), oracleContext);
+		else
+			encryptionCell(temp, key, &(ciphertexts[j][0]));
+	}
+}
+
+/*It returns 1 if there is at least one collision among the ciphertexts of a test; 0 otherwise*/
+
+int collisionTest(word8 ciphertexts[][16]){
+
+	int i, j, t, s;
+	word8 temp3[4][4];
+
+	for (i = 0; i<cellValues; i++)
+	{
+		for (j = i + 1; j<cellValues; j++)
+		{
+			for (t = 0; t<4; t++)
+			{
+				for (s = 0; s<4; s++)
+				{
+					temp3[s][t] = ciphertexts[i][s + 4 * t] ^ ciphertexts[j][s + 4 * t];
+				}
+			}
+
+			if (belongToW(temp3) > 0)
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+/*Same as encryptTest, but with encryptionCollision (small scale AES, secret key): states for collisionTestDiagonal*/
+
+void encryptTestCollision(word8 storeMemory[][4], long int k, word8 key[][4], word8 states[][16]){
+
+	int i, j;
+	word8 temp[4][4], testConstant[12];
+	int index[12] = { 1, 2, 3, 4, 6, 7, 8, 9, 11, 12, 13, 14 };
+
+	testConstants(k, testConstant);
+	for (i = 0; i < 12; i++)
+		temp[index[i] / 4][index[i] % 4] = testConstant[i];
+
+	for (j = 0; j<16; j++)
+	{
+		temp[0][0] = storeMemory[j][0];
+		temp[1][1] = storeMemory[j][1];
+		temp[2][2] = storeMemory[j][2];
+		temp[3][3] = storeMemory[j][3];
+
+		encryptionCollision(temp, key, &(states[j][0]));
+	}
+}
+
+/*Same as collisionTest, on the states of encryptionCollision: a collision is an equal group of 4 nibbles (16-bit lane)*/
+
+int collisionTestDiagonal(word8 states[][16]){
+
+	int i, j;
+	word64 packed[16], d;
+
+	for (i = 0; i<16; i++)
+		packed[i] = packState(&(states[i][0]));
+
+	for (i = 0; i<16; i++)
+	{
+		for (j = i + 1; j<16; j++)
+		{
+			d = packed[i] ^ packed[j];
+			if (((d & 0xffffULL) == 0) || ((d & 0xffff0000ULL) == 0) || ((d & 0xffff00000000ULL) == 0) || ((d & 0xffff000000000000ULL) == 0))
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+/*Pairs with a collision among the states of encryptionCollision of a test*/
+
+int collisionCountDiagonal(word8 states[][16]){
+
+	int i, j, n = 0;
+	word64 packed[16], d;
+
+	for (i = 0; i<16; i++)
+		packed[i] = packState(&(states[i][0]));
+
+	for (i = 0; i<16; i++)
+	{
+		for (j = i + 1; j<16; j++)
+		{
+			d = packed[i] ^ packed[j];
+			n += (((d & 0xffffULL) == 0) || ((d & 0xffff0000ULL) == 0) || ((d & 0xffff00000000ULL) == 0) || ((d & 0xffff000000000000ULL) == 0));
+		}
+	}
+
+	return n;
+}
+
+void pipelineGenerator(pipelineRing *ring, word8 key[][4]){
+
+	long long candidate;
+	long int k;
+	unsigned long tail;
+	word8 storeMemory[MAX_CELL_VALUES][4];
+	pipelineBatch *batch;
+
+	while ((candidate = nextCandidate.fetch_add(1)) < lastCandidate)
+	{
+		prepareStoreMemory(candidateCell(candidate, 0), candidateCell(candidate, 1), candidateCell(candidate, 2), candidateCell(candidate, 3), storeMemory);
+
+		tail = ring->tail.load(std::memory_order_relaxed);
+
+		for (k = 0; k<testBudget; k++)
+		{
+			//backpressure: wait for a free slot, unless the candidate has been eliminated in the meantime
+			while ((tail - ring->head.load(std::memory_order_acquire) == PIPELINE_RING_SIZE) && (ring->cancelled.load(std::memory_order_relaxed) != candidate))
+				std::this_thread::yield();
+
+			if (ring->cancelled.load(std::memory_order_relaxed) == candidate)
+				break;
+
+			batch = &(ring->slot[tail & (PIPELINE_RING_SIZE - 1)]);
+			batch->candidate = candidate;
+			batch->last = (k == testBudget - 1);
+			batch->collisionForm = (k >= cacheTests) && (oracle == NULL) && (cellBits == 4);
+			if (k < cacheTests)
+				cachedTest(storeMemory, k, batch->cipher);
+			else if (batch->collisionForm)
+				encryptTestCollision(storeMemory, k, key, batch->cipher);
+			else
+				encryptTest(storeMemory, k, key, batch->cipher);
+
+			tail++;
+			ring->tail.store(tail, std::memory_order_release);
+		}
+
+		telemetry.encryptions.fetch_add((k - ((k < cacheTests) ? k : cacheTests)) * cellValues, std::memory_order_relaxed);
+	}
+
+	ring->done.store(1, std::memory_order_release);
+}
+
+void pipelineChecker(pipelineRing *ring){
+
+	long long eliminated = -1, numberTests = 0, *grown;
+	int collisions;
+	unsigned long head, tail;
+	pipelineBatch *batch;
+
+	head = ring->head.load(std::memory_order_relaxed);
+
+	for (;;)
+	{
+		tail = ring->tail.load(std::memory_order_acquire);
+
+		if (head == tail)
+		{
+			if (ring->done.load(std::memory_order_acquire) && (head == ring->tail.load(std::memory_order_acquire)))
+				break;
+			std::this_thread::yield();
+			continue;
+		}
+
+		for (; head != tail; head++)
+		{
+			batch = &(ring->slot[head & (PIPELINE_RING_SIZE - 1)]);
+
+			//tests produced before the cancellation reached the generator are discarded
+			if (batch->candidate == eliminated)
+				continue;
+
+			numberTests++;
+
+			if (((batch->collisionForm) ? collisionTestDiagonal(batch->cipher) : collisionTest(batch->cipher)) > 0)
+			{
+				eliminated = batch->candidate;
+				ring->cancelled.store(eliminated, std::memory_order_relaxed);
+				telemetryCandidate(numberTests, 0, 0);
+				collisions = 1;
+				if (resultKeepsEliminated())
+					collisions = (batch->collisionForm) ? collisionCountDiagonal(batch->cipher) : collisionCount(batch->cipher, cellValues);
+				resultCandidate(eliminated, 0, numberTests, collisions, eliminated == rightCandidate);
+				numberTests = 0;
+			}
+			else if (batch->last)
+			{
+				telemetryCandidate(numberTests, 0, 1);
+				resultCandidate(batch->candidate, 0, numberTests, 0, batch->candidate == rightCandidate);
+				numberTests = 0;
+
+				std::lock_guard<std::mutex> lock(survivorMutex);
+
+				nSurvivor++;
+				if ((nStoredSurvivor == maxSurvivor) && (maxSurvivor < PIPELINE_MAX_SURVIVORS))
+				{
+					grown = (long long *)realloc(survivor, (2 * maxSurvivor + 16) * sizeof(long long));
+					if (grown != NULL)
+					{
+						survivor = grown;
+						maxSurvivor = 2 * maxSurvivor + 16;
+					}
+				}
+				if (nStoredSurvivor < maxSurvivor)
+					survivor[nStoredSurvivor++] = batch->candidate;
+			}
+		}
+
+		ring->head.store(head, std::memory_order_release);
+	}
+
+	lanesRunning.fetch_sub(1);
+}
+
+int compareCandidate(const void *a, const void *b){
+
+	long long x = *(const long long *)a, y = *(const long long *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*Pipelined sweep of the candidates in [first, last): at the end, nSurvivor candidates survived, and the first PIPELINE_MAX_SURVIVORS
+found (all of them, if the memory is enough) are in survivor[0 - nStoredSurvivor-1], sorted.
+If progress is not NULL, it is called by this thread during the sweep (see aes5Progress). It returns 1 if progress cancelled the
+sweep, 0 otherwise*/
+
+int runPipeline(word8 key[][4], int nLanes, long long first, long long last, aes5Progress progress = NULL, void *context = NULL)
+{
+	int i, j, cancelled = 0;
+	pipelineRing *ring;
+	std::thread *generator, *checker;
+
+	generateConstants();
+
+	ring = new pipelineRing[nLanes];
+	generator = new std::thread[nLanes];
+	checker = new std::thread[nLanes];
+
+	nextCandidate.store(first);
+	lastCandidate = last;
+	nSurvivor = 0;
+	nStoredSurvivor = 0;
+	rightCandidate = 0;
+	for (i = 0; i < 4; i++)
+		rightCandidate = (rightCandidate << cellBits) | key[i][i];
+	if (oracle != NULL)
+		rightCandidate = -1;
+	lanesRunning.store(nLanes);
+	resetTelemetry(last - first);
+
+	for (i = 0; i < nLanes; i++)
+	{
+		ring[i].cipherMemory = new word8[PIPELINE_RING_SIZE * cellValues][16];
+		for (j = 0; j < PIPELINE_RING_SIZE; j++)
+			ring[i].slot[j].cipher = ring[i].cipherMemory + j * cellValues;
+		ring[i].head.store(0);
+		ring[i].tail.store(0);
+		ring[i].cancelled.store(-1);
+		ring[i].done.store(0);
+		checker[i] = std::thread(pipelineChecker, &(ring[i]));
+		generator[i] = std::thread(pipelineGenerator, &(ring[i]), key);
+	}
+
+	while (progress != NULL)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+		//cancellation: the generators do not take new candidates
+		if ((cancelled == 0) && (progress(telemetry.candidatesDone.load(), last - first, telemetry.survivors.load(), context) != 0))
+		{
+			nextCandidate.store(last);
+			cancelled = 1;
+		}
+
+		if (lanesRunning.load() == 0)
+			break;
+	}
+
+	for (i = 0; i < nLanes; i++)
+	{
+		generator[i].join();
+		checker[i].join();
+		delete[] ring[i].cipherMemory;
+	}
+
+	delete[] generator;
+	delete[] checker;
+	delete[] ring;
+
+	qsort(survivor, nStoredSurvivor, sizeof(long long), compareCandidate);
+
+	return cancelled;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**MULTI-KEY BITSLICED ENCRYPTION (small scale AES):
+64 independent keys are encrypted together, one for each bit (lane) of a word64. A state is 16 x 4 bit planes: plane[p][b] has in the
+lane l the bit b of the nibble in position p (= j + 4*i, as the ciphertext of encryption) for the key l.
+- S-box: algebraic normal form of sBox (sliceANF: the monomials of each output bit), so any S-box of loadSPNVariant can be used;
+- MixColumns: each output bit of a column is the xor of some of its 16 input bits (sliceMixIndex);
+- ShiftRows: only an index permutation;
+- key schedule: the same operations on the key planes, once for each group of keys (sliceExpandKey) and not at each encryption.
+The collision test is bitsliced too: the difference of two ciphertexts has a zero nibble in the lanes where no one of its 4 planes
+is set, and the lanes with a collision are the ones with the 4 zero nibbles of one of the subspaces of belongToW.
+multiKeyCollisionTest runs the tests of newWay_contNumberCollisionAES on 64 (key, candidate) pairs at once, with shared constants.
+initializationSlice must be called after initializationSPN (or loadSPNVariant).
+*/
+
+#define MULTI_KEY_LANES 64
+
+word8 sliceANF[4][16], sliceANFCount[4];
+word8 sliceMixIndex[16][16], sliceMixCount[16];
+
+void initializationSlice(){
+
+	int b, bb, i, r, x, n;
+	word8 anf[16];
+
+	for (b = 0; b < 4; b++)
+	{
+		//Moebius transform of the output bit b
+		for (x = 0; x < 16; x++)
+			anf[x] = (sBox[x] >> b) & 0x1;
+		for (i = 1; i < 16; i <<= 1)
+		{
+			for (x = 0; x < 16; x++)
+			{
+				if (x & i)
+					anf[x] ^= anf[x ^ i];
+			}
+		}
+
+		n = 0;
+		for (x = 0; x < 16; x++)
+		{
+			if (anf[x])
+				sliceANF[b][n++] = (word8)x;
+		}
+		sliceANFCount[b] = (word8)n;
+	}
+
+	for (r = 0; r < 4; r++)
+	{
+		for (b = 0; b < 4; b++)
+		{
+			n = 0;
+			for (i = 0; i < 4; i++)
+			{
+				for (bb = 0; bb < 4; bb++)
+				{
+					if ((multiplication(mixMatrix[r][i], (word8)(1 << bb)) >> b) & 0x1)
+						sliceMixIndex[4 * r + b][n++] = (word8)(4 * i + bb);
+				}
+			}
+			sliceMixCount[4 * r + b] = (word8)n;
+		}
+	}
+}
+
+/*S-box on the 4 planes of a nibble: the monomial x (product of the input bits in x) is m[x]*/
+
+void sliceSBox(word64 *x){
+
+	int i, b, n;
+	word64 m[16], y[4];
+
+	m[0] = ~0ULL;
+	for (i = 1; i < 16; i++)
+		m[i] = m[i & (i - 1)] & x[__builtin_ctz(i)];
+
+	for (b = 0; b < 4; b++)
+	{
+		y[b] = 0;
+		for (n = 0; n < sliceANFCount[b]; n++)
+			y[b] ^= m[sliceANF[b][n]];
+	}
+
+	for (b = 0; b < 4; b++)
+		x[b] = y[b];
+}
+
+void sliceMixColumn(word64 state[][4], int c){
+
+	int i, b, n;
+	word64 input[16];
+
+	for (i = 0; i < 4; i++)
+	{
+		for (b = 0; b < 4; b++)
+			input[4 * i + b] = state[4 * i + c][b];
+	}
+
+	for (i = 0; i < 16; i++)
+	{
+		state[4 * (i / 4) + c][i % 4] = 0;
+		for (n = 0; n < sliceMixCount[i]; n++)
+			state[4 * (i / 4) + c][i % 4] ^= input[sliceMixIndex[i][n]];
+	}
+}
+
+/*Round keys of N_Round rounds (as generationRoundKey)*/
+
+void sliceExpandKey(word64 key[][4], word64 roundKey[][16][4]){
+
+	int i, r, c, b;
+	word8 rCostante;
+	word64 colonnaTemp[4][4];
+
+	memcpy(roundKey[0], key, 16 * 4 * sizeof(word64));
+
+	for (i = 0; i < N_Round; i++)
+	{
+		memcpy(roundKey[i + 1], roundKey[i], 16 * 4 * sizeof(word64));
+
+		//rotation and S-box of the column 3
+		for (r = 0; r < 4; r++)
+		{
+			for (b = 0; b < 4; b++)
+				colonnaTemp[r][b] = roundKey[i][4 * ((r + 1) % 4) + 3][b];
+			sliceSBox(colonnaTemp[r]);
+		}
+
+		if (i == 0)
+			rCostante = 0x1;
+		else{
+			rCostante = 0x2;
+			for (r = 1; r < i; r++)
+				rCostante = multiplicationX(rCostante);
+		}
+		for (b = 0; b < 4; b++)
+		{
+			if ((rCostante >> b) & 0x1)
+				colonnaTemp[0][b] = ~colonnaTemp[0][b];
+		}
+
+		for (r = 0; r < 4; r++)
+		{
+			for (b = 0; b < 4; b++)
+				roundKey[i + 1][4 * r][b] ^= colonnaTemp[r][b];
+
+			for (c = 1; c < 4; c++)
+			{
+				for (b = 0; b < 4; b++)
+					roundKey[i + 1][4 * r + c][b] ^= roundKey[i + 1][4 * r + c - 1][b];
+			}
+		}
+	}
+}
+
+/*Encryption of 64 states with 64 keys on N_Round rounds (the last one without MixColumns)*/
+
+void sliceEncryption(word64 state[][4], word64 roundKey[][16][4]){
+
+	int i, p, r, c, b;
+	word64 temp[16][4];
+
+	for (p = 0; p < 16; p++)
+	{
+		for (b = 0; b < 4; b++)
+			state[p][b] ^= roundKey[0][p][b];
+	}
+
+	for (i = 1; i <= N_Round; i++)
+	{
+		//byte sub transformation and shift rows
+		for (r = 0; r < 4; r++)
+		{
+			for (c = 0; c < 4; c++)
+			{
+				for (b = 0; b < 4; b++)
+					temp[4 * r + c][b] = state[4 * r + (c + r) % 4][b];
+				sliceSBox(temp[4 * r + c]);
+			}
+		}
+
+		memcpy(state, temp, sizeof(temp));
+
+		if (i < N_Round)
+		{
+			for (c = 0; c < 4; c++)
+				sliceMixColumn(state, c);
+		}
+
+		for (p = 0; p < 16; p++)
+		{
+			for (b = 0; b < 4; b++)
+				state[p][b] ^= roundKey[i][p][b];
+		}
+	}
+}
+
+/*keys[0 - nKeys-1] (at most 64) in bit planes*/
+
+void sliceKeys(word8 keys[][4][4], int nKeys, word64 planes[][4]){
+
+	int l, p, b;
+
+	memset(planes, 0, 16 * 4 * sizeof(word64));
+
+	for (l = 0; l < nKeys; l++)
+	{
+		for (p = 0; p < 16; p++)
+		{
+			for (b = 0; b < 4; b++)
+				planes[p][b] |= (word64)((keys[l][p / 4][p % 4] >> b) & 0x1) << l;
+		}
+	}
+}
+
+/*Nibbles (position j + 4*i) of the lane l*/
+
+void unsliceState(word64 planes[][4], int l, word8 *p){
+
+	int i, b;
+
+	for (i = 0; i < 16; i++)
+	{
+		*(p + i) = 0;
+		for (b = 0; b < 4; b++)
+			*(p + i) |= (word8)(((planes[i][b] >> l) & 0x1) << b);
+	}
+}
+
+/*Lanes where the xor of the ciphertexts a and b belongs to W (see belongToWPacked)*/
+
+word64 sliceBelongToW(word64 a[][4], word64 b[][4]){
+
+	int p;
+	word64 zero[16];
+
+	for (p = 0; p < 16; p++)
+		zero[p] = ~((a[p][0] ^ b[p][0]) | (a[p][1] ^ b[p][1]) | (a[p][2] ^ b[p][2]) | (a[p][3] ^ b[p][3]));
+
+	return (zero[0] & zero[7] & zero[10] & zero[13]) | (zero[1] & zero[4] & zero[11] & zero[14]) |
+		(zero[2] & zero[5] & zero[8] & zero[15]) | (zero[3] & zero[6] & zero[9] & zero[12]);
+}
+
+/*numberTests tests (constants of the tests 0 - numberTests-1) for the lanes l < nKeys: the key keys[l] and the candidate candidates[l] of the diagonal
+(k1 in the most significant nibble). eliminatedAt[l] = number of tests until the first collision (numberTests if the lane survives).
+It returns the mask of the lanes that survive*/
+
+word64 multiKeyCollisionTest(word8 keys[][4][4], int *candidates, int nKeys, long int numberTests, long int *eliminatedAt){
+
+	int i, j, l, n, b, position;
+	long int k;
+	word64 keyPlanes[16][4], roundKey[N_Round + 1][16][4], candidatePlanes[4][4], ciphertexts[16][16][4];
+	word64 alive, collided, eliminated;
+	word8 base[16][4], testConstant[12];
+
+	prepareStoreMemory(0x0, 0x0, 0x0, 0x0, base);
+
+	sliceKeys(keys, nKeys, keyPlanes);
+	sliceExpandKey(keyPlanes, roundKey);
+
+	memset(candidatePlanes, 0, sizeof(candidatePlanes));
+	for (l = 0; l < nKeys; l++)
+	{
+		for (i = 0; i < 4; i++)
+		{
+			for (b = 0; b < 4; b++)
+				candidatePlanes[i][b] |= (word64)((candidates[l] >> (12 - 4 * i + b)) & 0x1) << l;
+		}
+	}
+
+	alive = (nKeys == MULTI_KEY_LANES) ? ~0ULL : ((1ULL << nKeys) - 1);
+
+	for (k = 0; (k < numberTests) && (alive != 0); k++)
+	{
+		testConstants(k, testConstant);
+		for (j = 0; j < 16; j++)
+		{
+			n = 0;
+			for (position = 0; position < 16; position++)
+			{
+				for (b = 0; b < 4; b++)
+				{
+					if ((position % 4) == (position / 4))
+						ciphertexts[j][position][b] = (0ULL - (word64)((base[j][position / 4] >> b) & 0x1)) ^ candidatePlanes[position / 4][b];
+					else
+						ciphertexts[j][position][b] = 0ULL - (word64)((testConstant[n] >> b) & 0x1);
+				}
+				if ((position % 4) != (position / 4))
+					n++;
+			}
+
+			sliceEncryption(ciphertexts[j], roundKey);
+		}
+
+		collided = 0;
+		for (i = 0; (i < 16) && ((alive & ~collided) != 0); i++)
+		{
+			for (j = i + 1; j < 16; j++)
+				collided |= sliceBelongToW(ciphertexts[i], ciphertexts[j]);
+		}
+
+		eliminated = alive & collided;
+		for (l = 0; l < nKeys; l++)
+		{
+			if ((eliminated >> l) & 0x1)
+				eliminatedAt[l] = k + 1;
+		}
+		alive &= ~collided;
+	}
+
+	for (l = 0; l < nKeys; l++)
+	{
+		if ((alive >> l) & 0x1)
+			eliminatedAt[l] = numberTests;
+	}
+
+	return alive;
+}
+
+/*All the nKeys (key, candidate) pairs, in groups of 64 lanes on nThreads threads. It returns the number of survivors*/
+
+std::atomic<int> nextGroup;
+
+void multiKeyWorker(word8 (*keys)[4][4], int *candidates, int nKeys, long int numberTests, long int *eliminatedAt, std::atomic<long long> *nSurvivors){
+
+	int group, n;
+
+	while ((group = nextGroup.fetch_add(MULTI_KEY_LANES)) < nKeys)
+	{
+		n = (nKeys - group < MULTI_KEY_LANES) ? nKeys - group : MULTI_KEY_LANES;
+		nSurvivors->fetch_add(__builtin_popcountll(multiKeyCollisionTest(&(keys[group]), &(candidates[group]), n, numberTests, &(eliminatedAt[group]))));
+	}
+}
+
+long long multiKeyRun(word8 keys[][4][4], int *candidates, int nKeys, long int numberTests, long int *eliminatedAt, int nThreads){
+
+	int i;
+	std::thread *worker;
+	std::atomic<long long> nSurvivors;
+
+	nSurvivors.store(0);
+	nextGroup.store(0);
+
+	worker = new std::thread[nThreads];
+	for (i = 0; i < nThreads; i++)
+		worker[i] = std::thread(multiKeyWorker, keys, candidates, nKeys, numberTests, eliminatedAt, &nSurvivors);
+	for (i = 0; i < nThreads; i++)
+		worker[i].join();
+	delete[] worker;
+
+	return nSurvivors.load();
+}
+
+/*Success probability over nKeys random keys: for each key the right candidate of the diagonal (it must survive) and a random wrong one
+(it must be eliminated)*/
+
+int multiKeyExperiment(int nKeys, int nThreads){
+
+	int i, j, l, wrongSurvivors, rightSurvivors;
+	word8 (*keys)[4][4];
+	int *candidates;
+	long int *eliminatedAt;
+	double meanTests;
+
+	initializationSlice();
+	generateConstants();
+
+	keys = (word8 (*)[4][4])malloc(2 * nKeys * sizeof(keys[0]));
+	candidates = (int *)malloc(2 * nKeys * sizeof(int));
+	eliminatedAt = (long int *)malloc(2 * nKeys * sizeof(long int));
+
+	//lanes l: right candidate of the key l, lanes nKeys+l: a wrong one for the same key (the groups of wrong candidates end early)
+	for (l = 0; l < nKeys; l++)
+	{
+		for (i = 0; i < 4; i++)
+		{
+			for (j = 0; j < 4; j++)
+				keys[l][i][j] = randomByte();
+		}
+		memcpy(keys[nKeys + l], keys[l], sizeof(keys[0]));
+
+		candidates[l] = (keys[l][0][0] << 12) | (keys[l][1][1] << 8) | (keys[l][2][2] << 4) | keys[l][3][3];
+		do
+			candidates[nKeys + l] = (randomByte() << 12) | (randomByte() << 8) | (randomByte() << 4) | randomByte();
+		while (candidates[nKeys + l] == candidates[l]);
+	}
+
+	multiKeyRun(keys, candidates, 2 * nKeys, testBudget, eliminatedAt, nThreads);
+
+	rightSurvivors = 0;
+	wrongSurvivors = 0;
+	meanTests = 0.0;
+	for (l = 0; l < nKeys; l++)
+	{
+		rightSurvivors += (eliminatedAt[l] == testBudget);
+		wrongSurvivors += (eliminatedAt[nKeys + l] == testBudget);
+		meanTests += eliminatedAt[nKeys + l];
+	}
+
+	printf("Keys: %d - tests: %ld\n", nKeys, testBudget);
+	printf("Right candidate survives: %d (success probability %.4f)\n", rightSurvivors, (double)rightSurvivors / nKeys);
+	printf("Wrong candidate survives: %d (%.4f) - mean number of tests to eliminate it: %.1f\n", wrongSurvivors, (double)wrongSurvivors / nKeys, meanTests / nKeys);
+
+	free(keys);
+	free(candidates);
+	free(eliminatedAt);
+
+	return (rightSurvivors == nKeys) ? 0 : 1;
+}
+
+/*Profile (see PROFILING) of the backends on the first nCandidates candidates, with the same key, on this thread:
+- the lane of the pipeline on the ciphertexts (encryptTest with encryptionFused, collisionTest), used with an oracle or -byte;
+- the lane of the pipeline on the states of encryptionCollision (encryptTestCollision, collisionTestDiagonal), used with the key;
+- the bitsliced multiKeyCollisionTest, 64 candidates at once (encryption and check together, in the phase "encryption").
+The tests of each candidate stop at the first collision, as in the sweeps*/
+
+void profileBackends(word8 key[][4], int nCandidates){
+
+	int c, l, n, backend, collision, candidates[MULTI_KEY_LANES];
+	long int k, eliminatedAt[MULTI_KEY_LANES];
+	word8 storeMemory[16][4], ciphertexts[16][16], keys[MULTI_KEY_LANES][4][4];
+	const char *backendName[3] = { "pipeline lane, ciphertexts (encryptTest, collisionTest)",
+		"pipeline lane, collision form (encryptTestCollision, collisionTestDiagonal)", "bitsliced (multiKeyCollisionTest, 64 lanes)" };
+
+	initializationSlice();
+	newConstants(4);
+	startProfiling();
+
+	for (backend = 0; backend < 3; backend++)
+	{
+		resetProfile();
+
+		for (c = 0; (c < nCandidates) && (backend < 2); c++)
+		{
+			profileBegin(PROFILE_GENERATION);
+			prepareStoreMemory((word8)(c >> 12), (word8)((c >> 8) & 0xf), (word8)((c >> 4) & 0xf), (word8)(c & 0xf), storeMemory);
+			profileEnd(PROFILE_GENERATION);
+
+			for (k = 0, collision = 0; (k < N_TEST) && (collision == 0); k++)
+			{
+				profileBegin(PROFILE_ENCRYPTION);
+				if (backend == 0)
+					encryptTest(storeMemory, k, key, ciphertexts);
+				else
+					encryptTestCollision(storeMemory, k, key, ciphertexts);
+				profileEnd(PROFILE_ENCRYPTION);
+
+				profileBegin(PROFILE_CHECK);
+				collision = (backend == 0) ? collisionTest(ciphertexts) : collisionTestDiagonal(ciphertexts);
+				profileEnd(PROFILE_CHECK);
+			}
+			profileTests += k;
+		}
+
+		for (c = 0; (c < nCandidates) && (backend == 2); c += MULTI_KEY_LANES)
+		{
+			n = (nCandidates - c < MULTI_KEY_LANES) ? nCandidates - c : MULTI_KEY_LANES;
+			for (l = 0; l < n; l++)
+			{
+				memcpy(keys[l], key, sizeof(keys[l]));
+				candidates[l] = c + l;
+			}
+
+			profileBegin(PROFILE_ENCRYPTION);
+			multiKeyCollisionTest(keys, candidates, n, N_TEST, eliminatedAt);
+			profileEnd(PROFILE_ENCRYPTION);
+
+			for (l = 0; l < n; l++)
+				profileTests += eliminatedAt[l];
+		}
+
+		printProfile(backendName[backend]);
+	}
+
+	stopProfiling();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**TRUNCATED DIFFERENTIALS (small scale AES):
+Markov-model estimate of the probability that a pair of texts of a test gives a collision (difference of the ciphertexts in W), for
+each class of key.
+The class of a candidate is the set of the wrong nibbles of its diagonal (bit r = row r, 0 = right key). A collision on nRounds
+rounds is a zero column of the difference of x_{nRounds-1} (the state after the last MixColumns: the final round has no MixColumns,
+and shift rows moves the column c on the anti-diagonal c - see belongToW).
+- First round, exact for the S-box: for each one of the 2^16 key differences d of the diagonal and each one of the 120 pairs of the
+  test, the difference of the column 0 after the round 1 is MC(S(S^-1(m_r(j1)) ^ d_r) ^ S(S^-1(m_r(j2)) ^ d_r)), m = MC^-1(j, 0, 0, 0)
+  as in newWay_contNumberCollisionAES: its active rows give truncatedFirstRound[class][pattern].
+- Columns: by enumeration of the 2^16 differences of a column, truncatedColumn[a][b] = probability that a difference with the
+  active rows a (uniform among them: that is the output of S-box differences averaged on the key) has the active rows b after
+  MixColumns.
+- Rounds 2 - nRounds-1: the distribution of the active nibbles of the state (2^16 patterns, bit r + 4c for row r and column c) goes
+  through shift rows and the 4 columns (truncatedColumn), with independent round keys (Markov cipher).
+The active rows of a packed column are found with shifts and masks on the 4 nibbles at once (columnPattern). The enumerations and the
+steps of the chain are split among the threads (disjoint counters or disjoint outputs).
+The collision of a test is 1 - (1 - pair)^120 (the pairs are taken as independent): truncatedTest is the average on the wrong
+candidates, and it replaces the random model in adaptiveBudget.
+Only the first round is exact: the independent round keys and the independent pairs are approximations, so truncatedMeasure checks
+the estimate of N_Round rounds against the rate of the tests with a collision of the real cipher (encryptTest and collisionTest) on
+TRUNCATED_SAMPLE_TESTS tests of random wrong candidates - -analysis prints both, and the self-test requires them to agree within
+TRUNCATED_SIGMAS standard deviations.
+*/
+
+#define TRUNCATED_PATTERNS (1 << 16)
+#define TRUNCATED_SAMPLE_TESTS (1 << 16)
+#define TRUNCATED_SAMPLE_CANDIDATE_TESTS 64 /* tests of each sampled candidate (at most N_TEST) */
+#define TRUNCATED_SIGMAS 5.0
+
+double truncatedColumn[16][16];
+double truncatedFirstRound[16][16];/* [class][active rows of the column 0 after the round 1] */
+double truncatedPair[6][16];/* [nRounds][class], for nRounds = 4, 5 */
+double truncatedTest[6];/* [nRounds]: wrong candidates (0 if not computed) */
+word64 truncatedSPN = 0;/* spnHash of the S-box and the matrix of the analysis */
+int truncatedDone = 0;
+
+/*Active rows (bit r) of a packed column*/
+
+inline int columnPattern(unsigned short colonna){
+
+	colonna |= colonna >> 1;
+	colonna |= colonna >> 2;
+	colonna &= 0x1111;
+
+	return (colonna & 0x1) | ((colonna >> 3) & 0x2) | ((colonna >> 6) & 0x4) | ((colonna >> 9) & 0x8);
+}
+
+void truncatedColumnWorker(int first, int last, long long count[][16]){
+
+	int v;
+
+	for (v = first; v < last; v++)
+		count[columnPattern((unsigned short)v)][columnPattern(mixTable[0][v & 0xf] ^ mixTable[1][(v >> 4) & 0xf] ^ mixTable[2][(v >> 8) & 0xf] ^ mixTable[3][v >> 12])]++;
+}
+
+void truncatedFirstRoundWorker(int first, int last, long long count[][16]){
+
+	int d, j, l, r;
+	unsigned short colonna[16], m;
+
+	for (d = first; d < last; d++)
+	{
+		for (j = 0; j < 16; j++)
+		{
+			m = invMixTable[0][j];
+			colonna[j] = 0;
+			for (r = 0; r < 4; r++)
+				colonna[j] ^= mixTable[r][sBox[inv_s[(m >> (4 * r)) & 0xf] ^ ((d >> (4 * r)) & 0xf)]];
+		}
+
+		for (j = 0; j < 16; j++)
+		{
+			for (l = j + 1; l < 16; l++)
+				count[columnPattern((unsigned short)d)][columnPattern(colonna[j] ^ colonna[l])]++;
+		}
+	}
+}
+
+/*MixColumns of the column c on the distribution of the patterns: out[q] for q in [first, last)*/
+
+void truncatedColumnPass(const double *in, double *out, int c, int first, int last){
+
+	int q, a, b;
+	double sum;
+
+	for (q = first; q < last; q++)
+	{
+		b = (q >> (4 * c)) & 0xf;
+		sum = 0.0;
+		for (a = 0; a < 16; a++)
+			sum += in[(q & ~(0xf << (4 * c))) | (a << (4 * c))] * truncatedColumn[a][b];
+		out[q] = sum;
+	}
+}
+
+/*One round (S-box, shift rows, MixColumns) on the distribution of the patterns, on nThreads threads*/
+
+void truncatedRound(double *distribution, double *temp, int nThreads, std::thread *worker){
+
+	int p, q, r, c, i, pass;
+
+	//shift rows: the nibble (r, c + r) goes to (r, c)
+	for (p = 0; p < TRUNCATED_PATTERNS; p++)
+	{
+		q = 0;
+		for (r = 0; r < 4; r++)
+		{
+			for (c = 0; c < 4; c++)
+				q |= ((p >> (r + 4 * ((c + r) % 4))) & 0x1) << (r + 4 * c);
+		}
+		temp[q] = distribution[p];
+	}
+
+	//MixColumns, column by column
+	for (pass = 0; pass < 4; pass++)
+	{
+		for (i = 0; i < nThreads; i++)
+			worker[i] = std::thread(truncatedColumnPass, (pass % 2 == 0) ? temp : distribution, (pass % 2 == 0) ? distribution : temp, pass,
+				(int)(((long long)TRUNCATED_PATTERNS * i) / nThreads), (int)(((long long)TRUNCATED_PATTERNS * (i + 1)) / nThreads));
+		for (i = 0; i < nThreads; i++)
+			worker[i].join();
+	}
+
+	memcpy(distribution, temp, TRUNCATED_PATTERNS * sizeof(double));
+}
+
+/*It computes truncatedColumn, truncatedFirstRound, truncatedPair and truncatedTest (for 4 and 5 rounds) on nThreads threads*/
+
+void truncatedAnalysis(int nThreads){
+
+	int i, a, b, nRounds, round, p, c;
+	long long (*count)[16][16], total[16];
+	double *distribution, *temp, zero, wrong;
+	std::thread *worker;
+
+	if (nThreads < 1)
+		nThreads = 1;
+	worker = new std::thread[nThreads];
+	count = new long long[nThreads][16][16];
+	distribution = (double *)malloc(TRUNCATED_PATTERNS * sizeof(double));
+	temp = (double *)malloc(TRUNCATED_PATTERNS * sizeof(double));
+
+	//columns
+	memset(count, 0, nThreads * sizeof(count[0]));
+	for (i = 0; i < nThreads; i++)
+		worker[i] = std::thread(truncatedColumnWorker, (TRUNCATED_PATTERNS * i) / nThreads, (TRUNCATED_PATTERNS * (i + 1)) / nThreads, count[i]);
+	for (i = 0; i < nThreads; i++)
+		worker[i].join();
+
+	for (a = 0; a < 16; a++)
+	{
+		total[a] = 0;
+		for (b = 0; b < 16; b++)
+		{
+			for (i = 1; i < nThreads; i++)
+				count[0][a][b] += count[i][a][b];
+			total[a] += count[0][a][b];
+		}
+		for (b = 0; b < 16; b++)
+			truncatedColumn[a][b] = (double)count[0][a][b] / total[a];
+	}
+
+	//first round
+	memset(count, 0, nThreads * sizeof(count[0]));
+	for (i = 0; i < nThreads; i++)
+		worker[i] = std::thread(truncatedFirstRoundWorker, (TRUNCATED_PATTERNS * i) / nThreads, (TRUNCATED_PATTERNS * (i + 1)) / nThreads, count[i]);
+	for (i = 0; i < nThreads; i++)
+		worker[i].join();
+
+	for (a = 0; a < 16; a++)
+	{
+		total[a] = 0;
+		for (b = 0; b < 16; b++)
+		{
+			for (i = 1; i < nThreads; i++)
+				count[0][a][b] += count[i][a][b];
+			total[a] += count[0][a][b];
+		}
+		for (b = 0; b < 16; b++)
+			truncatedFirstRound[a][b] = (double)count[0][a][b] / total[a];
+	}
+
+	//rounds 2 - nRounds-1, for each class
+	for (a = 0; a < 16; a++)
+	{
+		memset(distribution, 0, TRUNCATED_PATTERNS * sizeof(double));
+		for (b = 0; b < 16; b++)
+			distribution[b] = truncatedFirstRound[a][b];
+
+		for (round = 2; round <= 4; round++)
+		{
+			truncatedRound(distribution, temp, nThreads, worker);
+
+			//state x_round: collision on round + 1 rounds
+			nRounds = round + 1;
+			if (nRounds < 4)
+				continue;
+
+			zero = 0.0;
+			for (p = 0; p < TRUNCATED_PATTERNS; p++)
+			{
+				for (c = 0; c < 4; c++)
+				{
+					if (((p >> (4 * c)) & 0xf) == 0)
+					{
+						zero += distribution[p];
+						break;
+					}
+				}
+			}
+			truncatedPair[nRounds][a] = zero;
+		}
+	}
+
+	//wrong candidates: class a has 15^|a| of them
+	for (nRounds = 4; nRounds <= 5; nRounds++)
+	{
+		wrong = 0.0;
+		for (a = 1; a < 16; a++)
+			wrong += pow(15.0, __builtin_popcount(a)) * (1.0 - pow(1.0 - truncatedPair[nRounds][a], 120.0));
+		truncatedTest[nRounds] = wrong / (N_CANDIDATES - 1);
+	}
+
+	truncatedSPN = spnHash();
+	truncatedDone = 1;
+
+	free(distribution);
+	free(temp);
+	delete[] count;
+	delete[] worker;
+}
+
+/*Analysis for the current S-box and matrix, if not done yet*/
+
+void truncatedUpdate(){
+
+	int nThreads = (int)std::thread::hardware_concurrency();
+
+	if ((truncatedDone == 0) || (truncatedSPN != spnHash()))
+		truncatedAnalysis((nThreads > 0) ? nThreads : 1);
+}
+
+void printTruncatedAnalysis(){
+
+	int a, b, q, nRounds;
+	double sum;
+
+	printf("Column transitions (rows 0 - in-1 active before MixColumns -> number of active rows after):\n");
+	printf("%8s", "in\\out");
+	for (b = 0; b <= 4; b++)
+		printf(" %12d", b);
+	printf("\n");
+	for (a = 1; a <= 4; a++)
+	{
+		printf("%8d", a);
+		for (b = 0; b <= 4; b++)
+		{
+			sum = 0.0;
+			for (q = 0; q < 16; q++)
+			{
+				if (__builtin_popcount(q) == b)
+					sum += truncatedColumn[(1 << a) - 1][q];
+			}
+			printf(" %12.6e", sum);
+		}
+		printf("\n");
+	}
+
+	printf("\nCollision of a pair / of a test (120 pairs), by class of key (wrong nibbles of the diagonal, row 0 first):\n");
+	printf("%6s %10s %14s %14s %14s %14s\n", "class", "candidates", "pair 4r", "test 4r", "pair 5r", "test 5r");
+	for (a = 0; a < 16; a++)
+	{
+		printf("   %d%d%d%d %10.0f", a & 0x1, (a >> 1) & 0x1, (a >> 2) & 0x1, (a >> 3) & 0x1, pow(15.0, __builtin_popcount(a)));
+		for (nRounds = 4; nRounds <= 5; nRounds++)
+			printf(" %14.6e %14.6e", truncatedPair[nRounds][a], 1.0 - pow(1.0 - truncatedPair[nRounds][a], 120.0));
+		printf("\n");
+	}
+
+	printf("\nWrong candidates, collision of a test: %.6e (4 rounds), %.6e (5 rounds) - random model %.6e\n", truncatedTest[4], truncatedTest[5],
+		1.0 - pow(1.0 - (1.0 - pow(1.0 - pow(2.0, -16.0), 4.0)), 120.0));
+	for (nRounds = 4; nRounds <= 5; nRounds++)
+	{
+		if (truncatedTest[nRounds] > 0.0)
+			printf("Tests for a false positive rate 2^-16 on %d rounds: %.0f\n", nRounds, ceil(-16.0 * log(2.0) / log(1.0 - truncatedTest[nRounds])));
+		else
+			printf("On %d rounds no key has collisions: the tests cannot separate the candidates\n", nRounds);
+	}
+}
+
+/*Rate of the tests with a collision on N_Round rounds for random wrong candidates of the key (all the tests of each candidate, not
+only up to the first collision), on the small scale AES: *sigma is its standard deviation under the Markov-model estimate of
+truncatedTest[N_Round] (truncatedUpdate must be done). It returns the deviation of the rate from the estimate, in units of *sigma*/
+
+double truncatedMeasure(word8 key[][4], double *measured, double *sigma){
+
+	int i, right, candidate, previousBits = cellBits, perCandidate;
+	long int k, nTests = 0, nCollisions = 0;
+	word8 storeMemory[MAX_CELL_VALUES][4], ciphertexts[MAX_CELL_VALUES][16];
+	double p;
+
+	selectCipher(4);
+	newConstants(4);
+
+	right = 0;
+	for (i = 0; i < 4; i++)
+		right = (right << 4) | key[i][i];
+	perCandidate = (TRUNCATED_SAMPLE_CANDIDATE_TESTS < N_TEST) ? TRUNCATED_SAMPLE_CANDIDATE_TESTS : N_TEST;
+
+	while (nTests < TRUNCATED_SAMPLE_TESTS)
+	{
+		do
+			candidate = (int)(genrand_int32() & 0xffff);
+		while (candidate == right);
+
+		prepareStoreMemory((word8)(candidate >> 12), (word8)((candidate >> 8) & 0xf), (word8)((candidate >> 4) & 0xf), (word8)(candidate & 0xf), storeMemory);
+		for (k = 0; k < perCandidate; k++, nTests++)
+		{
+			encryptTest(storeMemory, k, key, ciphertexts);
+			nCollisions += (collisionTest(ciphertexts) > 0);
+		}
+	}
+
+	selectCipher(previousBits);
+
+	p = ((N_Round >= 4) && (N_Round <= 5)) ? truncatedTest[N_Round] : 0.0;
+	*measured = (double)nCollisions / nTests;
+	*sigma = sqrt(p * (1.0 - p) / nTests);
+
+	return (*sigma > 0.0) ? (*measured - p) / *sigma : ((*measured == p) ? 0.0 : HUGE_VAL);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**ADAPTIVE TEST BUDGET:
+each test of a candidate is a Bernoulli trial "at least one of the pairs of the set has the difference of the ciphertexts in W".
+For a wrong candidate the ciphertexts behave as random, and the probability of a collision in a test is
+	p = 1 - (1 - w)^(setSize*(setSize-1)/2),	w = 1 - (1 - 2^-(4*cellBits))^4 (a random difference in one of the 4 subspaces of W);
+for the small scale AES on 4 or 5 rounds, p is the Markov-model estimate for the S-box and the matrix (truncatedTest, see TRUNCATED
+DIFFERENTIALS: truncatedMeasure checks it against the collisions of the cipher);
+for the right candidate it is q = 0 up to 5 rounds (impossible differential), and q = p beyond (no property).
+The sequential probability ratio test between "right" (q) and "wrong" (p) rejects a candidate at the first collision (the likelihood
+of "right" becomes 0), and accepts it after n tests without collisions, where n is the first one with (1 - p)^n <= falsePositive:
+so the budget of the survivors is n instead of N_TEST, and the false negative rate is 0 (falseNegative is met for any value).
+The budget is at most maxTests: if it is not enough, the achieved false positive rate is larger than the requested one.
+*/
+
+/*Budget for the rates falsePositive (wrong candidate that survives) and falseNegative (right candidate eliminated).
+The rates achieved with the budget are in achievedFP and achievedFN. It returns -1 if no budget can separate the candidates*/
+
+long int adaptiveBudget(double falsePositive, double falseNegative, int nRounds, int setSize, int bits, long int maxTests,
+	double *achievedFP, double *achievedFN)
+{
+	double w, p;
+	long int n;
+
+	w = 1.0 - pow(1.0 - pow(2.0, -4.0 * bits), 4.0);
+	p = 1.0 - pow(1.0 - w, setSize * (setSize - 1) / 2.0);
+	if ((bits == 4) && (setSize == 16) && ((nRounds == 4) || (nRounds == 5)))
+	{
+		truncatedUpdate();
+		p = truncatedTest[nRounds];
+	}
+
+	if ((nRounds > 5) || (p <= 0.0) || (falsePositive <= 0.0) || (falsePositive >= 1.0) || (falseNegative < 0.0))
+		return -1;
+
+	n = (long int)ceil(log(falsePositive) / log(1.0 - p));
+	if (n < 1)
+		n = 1;
+	if (n > maxTests)
+		n = maxTests;
+
+	*achievedFP = pow(1.0 - p, (double)n);
+	*achievedFN = 0.0;
+
+	return n;
+}
+
+/*1 if numberTests tests separate nCandidates candidates with cells of bits bits: each wrong candidate survives with probability at
+most falsePositive (if > 0), or at most 1 / nCandidates (one wrong survivor expected) otherwise. The tests needed are in *needed
+(-1 if no budget can separate the candidates)*/
+
+int budgetSeparates(int bits, long long nCandidates, double falsePositive, double falseNegative, long int numberTests, long int *needed){
+
+	double rate, achievedFP, achievedFN;
+
+	rate = (falsePositive > 0.0) ? falsePositive : 1.0 / (double)nCandidates;
+	if (rate >= 1.0)
+	{
+		*needed = 1;
+		return 1;
+	}
+
+	*needed = adaptiveBudget(rate, falseNegative, N_Round, 1 << bits, bits, LONG_MAX, &achievedFP, &achievedFN);
+
+	return (*needed > 0) && (*needed <= numberTests);
+}
+
+}
+
+using namespace aes5;
+
+long int aes5Budget(int cellBits, double falsePositive, double falseNegative, double *achievedFP, double *achievedFN){
+
+	return adaptiveBudget(falsePositive, falseNegative, N_Round, 1 << cellBits, cellBits, N_TEST, achievedFP, achievedFN);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**LIBRARY INTERFACE (see AES_5RoundDistinguisher.h):
+aes5Run is the pipelined distinguisher on a list of ranges of candidates. Each range is a run of the result sink, and before each
+range the generator is seeded again with config->seed, so the ranges use the same constants (as one sweep on their union).
+If a ciphertext cache is open (aes5OpenCache) for the same key and seed, the pipeline reads the tests it contains from it.
+The progress callback receives the candidates done and the survivors of the current range: if it cancels the run, the range is
+closed in the result sink as cancelled (with the candidates done) and the next ones are not started.
+The oracle of aes5SetOracle is called by the generator threads of all the lanes at the same time (see aes5Oracle).
+If config->falsePositive > 0, the tests for each candidate are the adaptive budget (see ADAPTIVE TEST BUDGET), at most
+config->numberTests: the budget and the rates it achieves are returned in *budget, so the callers do not compute them again.
+testBudget holds the budget only while the run is in progress, and then goes back to its previous value.
+*/
+
+int aes5Init(const char *spnFile, unsigned long seed){
+
+	if (spnFile != NULL)
+	{
+		if (loadSPNVariant(spnFile) != 0)
+			return 1;
+	}
+	else if (initializationSPN() != 0)
+		return 1;
+
+	init_genrand(seed);
+
+	return 0;
+}
+
+void aes5SetKey(word8 key[][4]){
+
+	memcpy(secretKey, key, sizeof(secretKey));
+}
+
+void aes5SetOracle(aes5Oracle newOracle, void *context){
+
+	oracle = newOracle;
+	oracleContext = context;
+}
+
+void aes5SetDecryptionOracle(aes5Oracle newOracle, void *context){
+
+	decryptionOracle = newOracle;
+	decryptionOracleContext = context;
+}
+
+int aes5OpenCache(const char *fileName, unsigned long seed, long int numberTests){
+
+	int nThreads = (int)std::thread::hardware_concurrency();
+
+	return cacheBuild(fileName, secretKey, seed, (numberTests > 0) ? numberTests : N_TEST, (nThreads > 0) ? nThreads : 1);
+}
+
+void aes5CloseCache(){
+
+	cacheClose();
+}
+
+long long aes5MultiKeyRun(word8 keys[][4][4], int *candidates, int nKeys, long int numberTests, unsigned long seed, long int *eliminatedAt, int nThreads){
+
+	if ((numberTests < 1) || (numberTests > N_TEST) || (nThreads < 1))
+		return -1;
+
+	selectCipher(4);
+	initializationSlice();
+	init_genrand(seed);
+	generateConstants();
+
+	return multiKeyRun(keys, candidates, nKeys, numberTests, eliminatedAt, nThreads);
+}
+
+long long aes5Run(const aes5Config *config, const aes5Range *range, int nRanges, long long *survivors, long long maxSurvivors,
+	aes5Progress progress, void *context, aes5RunBudget *budget)
+{
+	int r, i, cancelled = 0;
+	long long nTotal = 0, nListed = 0, nCandidates = 0;
+	long int needed, numberTests, previousBudget = testBudget;
+	double achievedFP = -1.0, achievedFN = -1.0;
+
+	if (((config->cellBits != 4) && (config->cellBits != 8)) || (config->nLanes < 1) || (config->numberTests < 0) || (config->numberTests > N_TEST))
+		return AES5_INVALID;
+
+	for (r = 0; r < nRanges; r++)
+	{
+		if ((range[r].first < 0) || (range[r].first > range[r].last) || (range[r].last > (1LL << (4 * config->cellBits))))
+			return AES5_INVALID;
+		nCandidates += range[r].last - range[r].first;
+	}
+
+	//full AES: N_TEST is far from enough (see CIPHER OF THE DISTINGUISHER), and the survivors would be almost all the candidates
+	if ((config->cellBits == 8) && (nCandidates > 0) &&
+		(budgetSeparates(8, nCandidates, config->falsePositive, config->falseNegative, (config->numberTests > 0) ? config->numberTests : N_TEST, &needed) == 0))
+		return AES5_INVALID;
+
+	selectCipher(config->cellBits);
+	numberTests = (config->numberTests > 0) ? config->numberTests : N_TEST;
+
+	if (config->falsePositive > 0.0)
+	{
+		numberTests = adaptiveBudget(config->falsePositive, config->falseNegative, N_Round, cellValues, cellBits, numberTests, &achievedFP, &achievedFN);
+		if (numberTests < 0)
+			return AES5_INVALID;
+	}
 
-	if ((p[3][0] == 0) && (p[2][1] == 0) && (p[1][2] == 0) && (p[0][3] == 0))
+	if (budget != NULL)
+	{
+		budget->numberTests = numberTests;
+		budget->falsePositive = achievedFP;
+		budget->falseNegative = achievedFN;
+	}
+
+	//the cache is used only if it has been built for this key, seed and cipher
+	cacheTests = 0;
+	if ((cacheMap != NULL) && (config->cellBits == 4) && (oracle == NULL) && (cacheInfo.seed == config->seed) &&
+		(cacheInfo.key == packState(&(secretKey[0][0]))) && (cacheInfo.spn == spnHash()))
+		cacheTests = (long int)cacheInfo.built;
+
+	//the global budget of the pipeline is this run's only while it runs
+	testBudget = numberTests;
+
+	for (r = 0; (r < nRanges) && (cancelled == 0); r++)
+	{
+		init_genrand(config->seed);
+
+		resultBeginRun(RESULT_AES, cellBits, config->nLanes, range[r].first, range[r].last);
+		cancelled = runPipeline(secretKey, config->nLanes, range[r].first, range[r].last, progress, context);
+		resultEndRun(telemetry.candidatesDone.load(), nSurvivor, cancelled);
+
+		for (i = 0; (i < nStoredSurvivor) && (nListed < maxSurvivors) && (cancelled == 0); i++)
+			survivors[nListed++] = survivor[i];
+		nTotal += nSurvivor;
+	}
+
+	testBudget = previousBudget;
+
+	if (cancelled == 1)
+		return AES5_CANCELLED;
+
+	return nTotal;
+}
+
+namespace aes5 {
+
+/*Same as distinguisher5Rounds with var = 0, but pipelined on nLanes generator/checker pairs of threads and only on the candidates
+in [first, last) - the whole space is [0, 2^(4*cellBits)). It is a client of aes5Run, as the programs that embed the library*/
+
+#define MAX_PRINTED_SURVIVORS 65536
+
+int distinguisher5RoundsPipeline(word8 key[][4], int nLanes, long long first, long long last, unsigned long seed, double falsePositive, double falseNegative)
+{
+	int i;
+	long long nnn, candidate, *found;
+	long int needed;
+	aes5Config config;
+	aes5Range range;
+	aes5RunBudget budget;
+
+	if ((cellBits == 8) && (last > first) && (budgetSeparates(8, last - first, falsePositive, falseNegative, N_TEST, &needed) == 0))
+	{
+		if (needed > 0)
+			printf("Error: %d tests cannot separate %lld candidates of the AES: they need %ld (compile with -DN_TEST=%ld).\n", N_TEST, last - first, needed, needed);
+		else
+			printf("Error: no budget of tests can separate the candidates of the AES for these rates.\n");
+		return 1;
+	}
+
+	config.cellBits = cellBits;
+	config.nLanes = nLanes;
+	config.numberTests = 0;
+	config.seed = seed;
+	config.falsePositive = falsePositive;
+	config.falseNegative = falseNegative;
+	range.first = first;
+	range.last = last;
+
+	found = (long long *)malloc(MAX_PRINTED_SURVIVORS * sizeof(long long));
+
+	aes5SetKey(key);
+	nnn = aes5Run(&config, &range, 1, found, MAX_PRINTED_SURVIVORS, NULL, NULL, &budget);
+
+	for (i = 0; (i < nnn) && (i < MAX_PRINTED_SURVIVORS) && (results.console == 1); i++)
+	{
+		candidate = found[i];
+
+		printf("0x%x - 0x%x - 0x%x - 0x%x", candidateCell(candidate, 0), candidateCell(candidate, 1), candidateCell(candidate, 2), candidateCell(candidate, 3));
+		if ((candidateCell(candidate, 0) == key[0][0]) && (candidateCell(candidate, 1) == key[1][1]) && (candidateCell(candidate, 2) == key[2][2]) && (candidateCell(candidate, 3) == key[3][3]))
+			printf(" - Right Key!\n");
+		else
+			printf(" - Wrong Key!\n");
+	}
+
+	free(found);
+
+	if (nnn < 0)
+	{
+		printf("Range not valid.\n");
+		return 1;
+	}
+	printf("Survivors: %lld of %lld candidates\n", nnn, last - first);
+
+	if (falsePositive > 0.0)
+	{
+		printf("Adaptive budget: %ld tests (instead of %d) - false positive <= %.3g for each candidate (%.3g expected wrong survivors), "
+			"false negative <= %.3g\n", budget.numberTests, N_TEST, budget.falsePositive, budget.falsePositive * (last - first - 1), budget.falseNegative);
+		if (budget.falsePositive > falsePositive)
+			printf("Warning: N_TEST is not enough for the false positive rate %.3g.\n", falsePositive);
+	}
+
+	if (nnn > 0)
+		return 0;
+	else
+		return 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**FULL KEY RECOVERY:
+the four diagonals of the round-0 key are recovered in one job.
+For the diagonal d, the active nibbles of the plaintexts are in the positions (i, i+d mod 4): with the right key, after one round
+they become one active nibble in the column d, exactly as for the main diagonal (d = 0).
+The 12 constants of each test are shared by the four diagonals (they fill the 12 non-active positions, in order).
+
+The job is test-major: for each test, all the candidates still alive (of the four diagonals) are checked, and the eliminated ones are
+dropped. In a test, the diagonal of the j-th plaintext of the candidate c is base[j] ^ c, where base[j] does not depend on c.
+So the same diagonal value is used by 16 different candidates, and its ciphertext is computed only once per test (cipherCache).
+At the end, the survivors of the four diagonals are combined and checked on a few known plaintext/ciphertext pairs.
+*/
+
+#define N_KNOWN_PAIRS 4
+
+int aliveCandidate[4][N_CANDIDATES], nAlive[4];
+word64 cipherCache[N_CANDIDATES];
+long int cacheStamp[N_CANDIDATES];
+
+/*Same as belongToW, but on the xor of two packed ciphertexts*/
+
+int belongToWPacked(word64 p)
+{
+	if ((p & 0x00f00f00f000000fULL) == 0)//positions 0, 7, 10, 13
+		return 1;
+
+	if ((p & 0x0f00f000000f00f0ULL) == 0)//positions 1, 4, 11, 14
+		return 1;
+
+	if ((p & 0xf000000f00f00f00ULL) == 0)//positions 2, 5, 8, 15
+		return 1;
+
+	if ((p & 0x000f00f00f00f000ULL) == 0)//positions 3, 6, 9, 12
+		return 1;
+
+	return 0;
+}
+
+/*Round-0 key nibble of the diagonal d in the row i*/
+
+int diagonalColumn(int i, int d){
+
+	return (i + d) % 4;
+}
+
+int fullKeyRecovery(word8 key[][4], word8 recoveredKey[][4])
+{
+	int d, i, j, l, n, c, diag, position, collision, found;
+	long int k, stamp, numberEncryption, numberQuery;
+	long int combination, nCombination;
+	word8 base[16][4], temp[4][4], temp2[16], testConstant[12];
+	word8 knownPlaintext[N_KNOWN_PAIRS][4][4], knownCiphertext[N_KNOWN_PAIRS][16];
+	word64 ciphertexts[16];
+	int rightDiagonal[4];
+
+	generateConstants();
+	prepareStoreMemory(0x0, 0x0, 0x0, 0x0, base);
+
+	for (d = 0; d < 4; d++)
+	{
+		nAlive[d] = N_CANDIDATES;
+		for (c = 0; c < N_CANDIDATES; c++)
+			aliveCandidate[d][c] = c;
+
+		rightDiagonal[d] = 0;
+		for (l = 0; l < 4; l++)
+			rightDiagonal[d] = (rightDiagonal[d] << 4) | key[l][diagonalColumn(l, d)];
+	}
+
+	for (diag = 0; diag < N_CANDIDATES; diag++)
+		cacheStamp[diag] = -1;
+
+	stamp = 0;
+	numberEncryption = 0;
+	numberQuery = 0;
+	resetTelemetry(4 * N_CANDIDATES);
+	resultBeginRun(RESULT_FULLKEY, 4, 0, 0, N_CANDIDATES);
+
+	for (k = 0; k<N_TEST; k++)
+	{
+		for (d = 0; d < 4; d++)
+		{
+			//the 12 constants of the test in the non-active positions
+			testConstants(k, testConstant);
+			n = 0;
+			for (position = 0; position < 16; position++)
+			{
+				if ((position % 4) != diagonalColumn(position / 4, d))
+					temp[position / 4][position % 4] = testConstant[n++];
+			}
+
+			n = 0;
+			for (i = 0; i < nAlive[d]; i++)
+			{
+				c = aliveCandidate[d][i];
+
+				for (j = 0; j < 16; j++)
+				{
+					diag = (((base[j][0] << 12) | (base[j][1] << 8) | (base[j][2] << 4) | base[j][3]) ^ c);
+
+					if (cacheStamp[diag] != stamp)
+					{
+						for (l = 0; l < 4; l++)
+							temp[l][diagonalColumn(l, d)] = (word8)((diag >> (12 - 4 * l)) & 0xf);
+
+						encryptionCell(temp, key, &(temp2[0]));
+						cipherCache[diag] = packState(&(temp2[0]));
+						cacheStamp[diag] = stamp;
+						numberEncryption++;
+					}
+
+					ciphertexts[j] = cipherCache[diag];
+				}
+
+				numberQuery += 16;
+
+				collision = 0;
+				for (j = 0; (j < 16) && (collision == 0); j++)
+				{
+					for (l = j + 1; l < 16; l++)
+					{
+						if (belongToWPacked(ciphertexts[j] ^ ciphertexts[l]) > 0)
+						{
+							collision = 1;
+							break;
+						}
+					}
+				}
+
+				if (collision == 0)
+					aliveCandidate[d][n++] = c;
+				else
+				{
+					//all the pairs of the test, only if the record is kept
+					if (resultKeepsEliminated())
+					{
+						collision = 0;
+						for (j = 0; j < 16; j++)
+						{
+							for (l = j + 1; l < 16; l++)
+								collision += (belongToWPacked(ciphertexts[j] ^ ciphertexts[l]) > 0);
+						}
+					}
+					resultCandidate(c, d, k + 1, collision, c == rightDiagonal[d]);
+				}
+			}
+
+			telemetry.tests.fetch_add(nAlive[d], std::memory_order_relaxed);
+			telemetry.candidatesDone.fetch_add(nAlive[d] - n, std::memory_order_relaxed);
+			telemetry.encryptions.store(numberEncryption, std::memory_order_relaxed);
+
+			nAlive[d] = n;
+			stamp++;
+		}
+	}
+
+	for (d = 0; d < 4; d++)
+	{
+		telemetry.candidatesDone.fetch_add(nAlive[d], std::memory_order_relaxed);
+		telemetry.survivors.fetch_add(nAlive[d], std::memory_order_relaxed);
+
+		for (i = 0; i < nAlive[d]; i++)
+			resultCandidate(aliveCandidate[d][i], d, N_TEST, 0, aliveCandidate[d][i] == rightDiagonal[d]);
+	}
+	resultEndRun(4 * N_CANDIDATES, nAlive[0] + nAlive[1] + nAlive[2] + nAlive[3]);
+
+	printf("Encryptions: %ld (instead of %ld)\n", numberEncryption, numberQuery);
+
+	for (d = 0; d < 4; d++)
+	{
+		printf("Diagonal %d - possible keys (row/column): 0/%d - 1/%d - 2/%d - 3/%d - survivors: %d\n", d, diagonalColumn(0, d), diagonalColumn(1, d), diagonalColumn(2, d), diagonalColumn(3, d), nAlive[d]);
+
+		for (i = 0; (i < nAlive[d]) && (results.console == 1); i++)
+		{
+			c = aliveCandidate[d][i];
+			printf("0x%x - 0x%x - 0x%x - 0x%x", c >> 12, (c >> 8) & 0xf, (c >> 4) & 0xf, c & 0xf);
+
+			if (c == rightDiagonal[d])
+				printf(" - Right Key!\n");
+			else
+				printf(" - Wrong Key!\n");
+		}
+
+		if (nAlive[d] == 0)
+			return 1;
+	}
+
+	//known pairs
+	for (n = 0; n < N_KNOWN_PAIRS; n++)
+	{
+		for (i = 0; i < 4; i++)
+		{
+			for (j = 0; j < 4; j++)
+				knownPlaintext[n][i][j] = randomByte();
+		}
+		encryption(knownPlaintext[n], key, &(knownCiphertext[n][0]));
+	}
+
+	//all the combinations of the survivors of the four diagonals
+	nCombination = (long int)nAlive[0] * nAlive[1] * nAlive[2] * nAlive[3];
+	found = 0;
+
+	for (combination = 0; (combination < nCombination) && (found == 0); combination++)
+	{
+		k = combination;
+		for (d = 0; d < 4; d++)
+		{
+			c = aliveCandidate[d][k % nAlive[d]];
+			k = k / nAlive[d];
+
+			for (l = 0; l < 4; l++)
+				recoveredKey[l][diagonalColumn(l, d)] = (word8)((c >> (12 - 4 * l)) & 0xf);
+		}
+
+		found = 1;
+		for (n = 0; (n < N_KNOWN_PAIRS) && (found == 1); n++)
+		{
+			encryption(knownPlaintext[n], recoveredKey, &(temp2[0]));
+
+			for (j = 0; j < 16; j++)
+			{
+				if (temp2[j] != knownCiphertext[n][j])
+				{
+					found = 0;
+					break;
+				}
+			}
+		}
+	}
+
+	if (found == 1)
+		return 0;
+	else
 		return 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**INTEGRAL (SQUARE) ATTACK - SIX ROUNDS, PARTIAL SUMS:
+a set of 2^16 plaintexts with all the values on the diagonal (and constants elsewhere) becomes, after one round, a column with all the
+values: that is a union of 2^12 sets with one active nibble at the input of the round 2, so after the round 4 (MixColumns and key
+included) every nibble of the state x4 is balanced (the xor over the set is 0).
+On N_Round + 1 = 6 rounds (the last one without MixColumns), the nibble (r, a+r) of x4 is S^-1(z) with
+	z = xor_i invMixMatrix[r][i] * S^-1(c[i][a-i] ^ k6[i][a-i]) ^ k5'[r][a]
+where c[i][a-i] is the anti-diagonal a of the ciphertext (see antiDiagonalColumn), k6 the last round key and k5' = MC^-1(k5).
+So the 2^16 guesses of the anti-diagonal a of k6, with the 16 guesses of k5'[r][a], are checked on the xor over the set, for r = 0 - 3.
+Partial sums (Ferguson et al.): the set is reduced to the parity of the 2^16 values of (c0, c1, c2, c3), and the nibbles are guessed one
+by one: after the guess of k6 in the row i, the ciphertext nibble of the row i is folded into the partial sum, and the table halves
+its number of nibbles. The cost is about 2^26 lookups per set and row, instead of 2^36 (2^20 guesses x 2^16 texts).
+The guesses are split among the threads by the nibble of the row 0. A set filters a wrong (k6, k5'[r]) with probability 15/16, and a
+guess of k6 survives if each row has a surviving k5'[r]: 3 sets are usually enough.
+*/
+
+/*Column of the ciphertext with the nibble of the row r of the anti-diagonal a*/
+
+int antiDiagonalColumn(int r, int a){
+
+	return (a - r + 4) % 4;
+}
+
+#define INTEGRAL_SET (1 << 16)
+
+word8 integralParity[INTEGRAL_SET];/* parity of the occurrences of (c0, c1, c2, c3) in the set */
+word8 integralTerm[4][4][16];/* integralTerm[r][i][v] = invMixMatrix[r][i] * S^-1(v) */
+unsigned short integralSurvivor[4][N_CANDIDATES];/* [r][guess of k6]: the surviving values of k5'[r][a] (bit mask) */
+
+/*Encrypt a set (diagonal over all the 2^16 values, random constants elsewhere) on N_Round + 1 rounds, and store the parities*/
+
+void integralCollectSet(word8 key[][4], int a){
+
+	int i, diag, n, position;
+	word8 temp[4][4], ciphertext[16];
+
+	n = 0;
+	for (position = 0; position < 16; position++)
+	{
+		if ((position % 4) != (position / 4))
+			temp[position / 4][position % 4] = randomByte();
+	}
+
+	memset(integralParity, 0, sizeof(integralParity));
+
+	for (diag = 0; diag < INTEGRAL_SET; diag++)
+	{
+		for (i = 0; i < 4; i++)
+			temp[i][i] = (word8)((diag >> (12 - 4 * i)) & 0xf);
+
+		encryptionRounds(temp, key, &(ciphertext[0]), N_Round + 1);
+
+		n = 0;
+		for (i = 0; i < 4; i++)
+			n = (n << 4) | ciphertext[antiDiagonalColumn(i, a) + 4 * i];
+		integralParity[n] ^= 1;
+	}
+}
+
+/*Partial sums for the row r and the guesses of k6 with the nibble of the row 0 in [first0, last0)*/
+
+void integralPartialSums(int r, int first0, int last0){
+
+	int k0, k1, k2, k3, k5, e, x, sum;
+	unsigned short zero;
+	word8 *level1, *level2, *level3, level4[16];
+
+	level1 = (word8 *)malloc(1 << 16);
+	level2 = (word8 *)malloc(1 << 12);
+	level3 = (word8 *)malloc(1 << 8);
+
+	for (k0 = first0; k0 < last0; k0++)
+	{
+		//(c0, c1, c2, c3) -> (x, c1, c2, c3)
+		memset(level1, 0, 1 << 16);
+		for (e = 0; e < (1 << 16); e++)
+			level1[(integralTerm[r][0][(e >> 12) ^ k0] << 12) | (e & 0xfff)] ^= integralParity[e];
+
+		for (k1 = 0; k1 < 16; k1++)
+		{
+			//(x, c1, c2, c3) -> (x, c2, c3)
+			memset(level2, 0, 1 << 12);
+			for (e = 0; e < (1 << 16); e++)
+				level2[(((e >> 12) ^ integralTerm[r][1][((e >> 8) & 0xf) ^ k1]) << 8) | (e & 0xff)] ^= level1[e];
+
+			for (k2 = 0; k2 < 16; k2++)
+			{
+				//(x, c2, c3) -> (x, c3)
+				memset(level3, 0, 1 << 8);
+				for (e = 0; e < (1 << 12); e++)
+					level3[(((e >> 8) ^ integralTerm[r][2][((e >> 4) & 0xf) ^ k2]) << 4) | (e & 0xf)] ^= level2[e];
+
+				for (k3 = 0; k3 < 16; k3++)
+				{
+					//(x, c3) -> x
+					memset(level4, 0, sizeof(level4));
+					for (e = 0; e < (1 << 8); e++)
+						level4[(e >> 4) ^ integralTerm[r][3][(e & 0xf) ^ k3]] ^= level3[e];
+
+					//xor of S^-1(x ^ k5') over the set
+					zero = 0;
+					for (k5 = 0; k5 < 16; k5++)
+					{
+						sum = 0;
+						for (x = 0; x < 16; x++)
+						{
+							if (level4[x])
+								sum ^= inv_s[x ^ k5];
+						}
+						if (sum == 0)
+							zero |= (unsigned short)(1 << k5);
+					}
+
+					integralSurvivor[r][(k0 << 12) | (k1 << 8) | (k2 << 4) | k3] &= zero;
+				}
+			}
+		}
+	}
+
+	free(level1);
+	free(level2);
+	free(level3);
+}
+
+/*Six rounds: anti-diagonal a of the last round key and column a of k5', with at most maxSets sets, on nThreads threads.
+It returns the number of surviving guesses of k6*/
+
+int integralKeyRecovery(word8 key[][4], int a, int maxSets, int nThreads)
+{
+	int i, r, v, g, set, nSurvivorIntegral, right, rightK5[4];
+	word8 lastKey[4][4], k5[4][4];
+	std::thread *worker;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	for (r = 0; r < 4; r++)
+	{
+		for (i = 0; i < 4; i++)
+		{
+			for (v = 0; v < 16; v++)
+				integralTerm[r][i][v] = (word8)((invMixTable[i][inv_s[v]] >> (4 * r)) & 0xf);
+		}
+	}
+
+	for (r = 0; r < 4; r++)
+	{
+		for (g = 0; g < N_CANDIDATES; g++)
+			integralSurvivor[r][g] = 0xffff;
+	}
+
+	if (nThreads > 16)
+		nThreads = 16;
+	worker = new std::thread[nThreads];
+	resultBeginRun(RESULT_INTEGRAL, 4, nThreads, 0, N_CANDIDATES);
+
+	nSurvivorIntegral = N_CANDIDATES;
+	for (set = 0; (set < maxSets) && (nSurvivorIntegral > 1); set++)
+	{
+		integralCollectSet(key, a);
+
+		for (r = 0; r < 4; r++)
+		{
+			for (i = 0; i < nThreads; i++)
+				worker[i] = std::thread(integralPartialSums, r, (16 * i) / nThreads, (16 * (i + 1)) / nThreads);
+			for (i = 0; i < nThreads; i++)
+				worker[i].join();
+		}
+
+		nSurvivorIntegral = 0;
+		for (g = 0; g < N_CANDIDATES; g++)
+			nSurvivorIntegral += (integralSurvivor[0][g] != 0) && (integralSurvivor[1][g] != 0) && (integralSurvivor[2][g] != 0) && (integralSurvivor[3][g] != 0);
+
+		printf("Set %d: %d surviving guesses of the anti-diagonal %d\n", set + 1, nSurvivorIntegral, a);
+	}
+
+	delete[] worker;
+
+	//k5 and k6, only to mark the right guess
+	initialization(&(lastKey[0][0]), key);
+	for (i = 0; i < N_Round + 1; i++)
+	{
+		if (i == N_Round)
+			memcpy(k5, lastKey, sizeof(k5));
+		generationRoundKey(&(lastKey[0][0]), i);
+	}
+
+	right = 0;
+	for (r = 0; r < 4; r++)
+		right = (right << 4) | lastKey[r][antiDiagonalColumn(r, a)];
+	for (r = 0; r < 4; r++)
+	{
+		rightK5[r] = 0;
+		for (i = 0; i < 4; i++)
+			rightK5[r] ^= (invMixTable[i][k5[i][a]] >> (4 * r)) & 0xf;
+	}
+
+	printf("Chosen plaintexts: %d x 2^16 - %.2f s\n", set, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+	for (g = 0; g < N_CANDIDATES; g++)
+	{
+		if ((integralSurvivor[0][g] == 0) || (integralSurvivor[1][g] == 0) || (integralSurvivor[2][g] == 0) || (integralSurvivor[3][g] == 0))
+		{
+			resultCandidate(g, a, set, 1, g == right);
+			continue;
+		}
+
+		resultCandidate(g, a, set, 0, g == right);
+
+		if ((nSurvivorIntegral <= 16) && (results.console == 1))
+		{
+			printf("0x%x - 0x%x - 0x%x - 0x%x (k5' column %d:", g >> 12, (g >> 8) & 0xf, (g >> 4) & 0xf, g & 0xf, a);
+			for (r = 0; r < 4; r++)
+			{
+				for (v = 0; v < 16; v++)
+				{
+					if ((integralSurvivor[r][g] >> v) & 0x1)
+						printf(" 0x%x", v);
+				}
+				printf((r < 3) ? " /" : ")");
+			}
+			if ((g == right) && (((integralSurvivor[0][g] >> rightK5[0]) & (integralSurvivor[1][g] >> rightK5[1]) & (integralSurvivor[2][g] >> rightK5[2]) & (integralSurvivor[3][g] >> rightK5[3]) & 0x1) == 1))
+				printf(" - Right Key!\n");
+			else
+				printf(" - Wrong Key!\n");
+		}
+	}
+	resultEndRun(N_CANDIDATES, nSurvivorIntegral);
+
+	return nSurvivorIntegral;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**CHOSEN-CIPHERTEXT DISTINGUISHER:
+the distinguisher of newWay_contNumberCollisionAES in the direction of the decryption, for oracles that only decrypt.
+The candidate is the anti-diagonal 0 of the last round key (g0, g1, g2, g3 in the rows 0 - 3, see antiDiagonalColumn): the 16
+ciphertexts of a test have the constants of the test k out of the anti-diagonal, and S(MC(e_a * v)[r]) ^ g_r in its row r, for
+v = 0 - 15, where e_a * v is the column with v in the row a (the active row of the structure) and 0 elsewhere.
+With the right guess, the inverse of the last round gives the column 0 = MC(e_a * v) ^ constant, that is one active nibble after
+the inverse MixColumns of the round N_Round - 1: the rest is the same property on 4 rounds of the inverse cipher, where a zero column
+after the last inverse MixColumns becomes a zero diagonal of the plaintext (inverse shift rows). So the right candidate never has a
+pair of plaintexts with difference in U (belongToU), and a wrong one has one with the same probability of the encryption direction.
+NOTE: with an S-box of the AES type (inversion and then an affine map), S(c * v) is affine in v^-1, so the 16 values of the
+anti-diagonal are a coset of a subspace of dimension 4: for the 15 guesses right ^ d with d in the subspace, the inverse of the last
+round gives again one active nibble, and they survive with the right one. The subspace depends on the coefficients of the column
+MC(e_a * v), so each candidate that survives the structure of the row 0 is tested again with the one of the row 1
+(CHOSEN_CIPHERTEXT_STRUCTURES): the two subspaces have only 0 in common, and only the right guess survives both. The candidates
+eliminated only by the second structure are marked in the result sink (RESULT_SECOND_STRUCTURE).
+The sweep runs on nThreads threads, each one on blocks of CHOSEN_CIPHERTEXT_BLOCK candidates: the decryption oracle (if any) is
+called from all of them at the same time.
+*/
+
+#define CHOSEN_CIPHERTEXT_STRUCTURES 2
+#define CHOSEN_CIPHERTEXT_BLOCK 64
+
+/*Pre-computed values of the anti-diagonal 0 for the candidate (g0, g1, g2, g3) and the active row a*/
+
+void prepareCiphertextMemory(word8 g0, word8 g1, word8 g2, word8 g3, int a, word8 storeMemory[][4]){
+
+	int i, j;
+
+	for (j = 0; j<16; j++)
+	{
+		for (i = 0; i<4; i++)
+			storeMemory[j][i] = byteTransformation((word8)((mixTable[a][j] >> (4 * i)) & 0xf));
+
+		storeMemory[j][0] ^= g0;
+		storeMemory[j][1] ^= g1;
+		storeMemory[j][2] ^= g2;
+		storeMemory[j][3] ^= g3;
+	}
+}
+
+/*Ciphertexts and plaintexts of the k-th test (as encryptTest): lastKey is the key of decryption (see lastRoundKey)*/
+
+void decryptTest(word8 storeMemory[][4], long int k, word8 lastKey[][4], word8 plaintexts[][16]){
 
-	return 0;
-}
+	int i, j;
+	word8 temp[4][4], testConstant[12];
+	int index[12] = { 1, 2, 3, 4, 5, 6, 8, 9, 11, 12, 14, 15 };
 
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	testConstants(k, testConstant);
+	for (j = 0; j<16; j++)
+	{
+		for (i = 0; i < 12; i++)
+			temp[index[i] / 4][index[i] % 4] = testConstant[i];
 
-/**AES CASE:
-for a fixed combination of delta0, delta1, delta2, delta3, it generates the corresponding collection, that is sets of plaintexts
-W_\Delta and the corresponding ciphertexts.
-Then it counts the number of collision in M.
+		for (i = 0; i < 4; i++)
+			temp[i][antiDiagonalColumn(i, 0)] = storeMemory[j][i];
 
-It returns 1 if there is at least one collision; 0 otherwise.
-In this last cast, it prints the possible right key.*/
+		if (decryptionOracle != NULL)
+			decryptionOracle(temp, &(plaintexts[j][0]), decryptionOracleContext);
+		else
+			decryptionFused(temp, lastKey, &(plaintexts[j][0]));
+	}
+}
 
-/*
-New way to generate plaintexts so as to use fewer plaintexts to distinguish the AES permutation from the random permutation
-We can view a column of size 2^4=16 as a unit.
-For the 2^4*4=2^16 different collections,each of them has about 2^11.7 columns.
-The nibbles in the same column whose position are (0,1),(0,2),(0,3),(1,0),(1,2),(1,3),(2,0),(2,1),(2,3),(3,0),(3,1),(3,2) are same.
-Therefore,it is neccessary to store the values at each column whose position are (0,1),(0,2),(0,3),(1,0),(1,2),(1,3),(2,0),(2,1),(2,3),(3,0),(3,1),(3,2) at the first row.
-Thus,we need another array of size N_TESTS*12=4100*12,that's about 1M memory which is feasible.
-*/
+/*Tests of the candidate (g0, g1, g2, g3) with the structure of the active row a: it returns 1 if there is at least one collision in
+U among the plaintexts, 0 otherwise; the tests executed and the collisions of the last test are in *numberTests and *numberCollisions.
+It has no global state (the constants of newConstants must be ready), so the threads of the sweep can call it*/
 
-int newWay_contNumberCollisionAES(word8 k1, word8 k2, word8 k3, word8 k4, word8 key[][4], int number)/* use number to check whether it is the first collection */
+int chosenCiphertextTest(word8 g0, word8 g1, word8 g2, word8 g3, int a, word8 lastKey[][4], long int *numberTests, int *numberCollisions)
 {
-	int i, j, numberCollision, t, s;
-	word8 storeMemory[16][4], v[4], temp2[16], temp3[4][4];
-	///
-	/*define temp as a two-dimensional array of size 4*4 instead of an one-dimensional array of size 16 */
-	///
-	word8 temp[4][4];
-
+	int i, j, t, s, numberCollision;
+	word8 storeMemory[16][4], plaintexts[16][16], temp3[4][4];
 	long int k;
 
-	//preparation plaintexts
-	for (j = 0; j<16; j++)
+	prepareCiphertextMemory(g0, g1, g2, g3, a, storeMemory);
+
+	for (k = 0; k<N_TEST; k++)
 	{
-		v[0] = (word8)j;
-		v[1] = 0x0;
-		v[2] = 0x0;
-		v[3] = 0x0;
+		decryptTest(storeMemory, k, lastKey, plaintexts);
 
-		partialInvMixColumn(&(v[0]));
+		numberCollision = 0;
+		for (i = 0; i<16; i++)
+		{
+			for (j = i + 1; j<16; j++)
+			{
+				for (t = 0; t<4; t++)
+				{
+					for (s = 0; s<4; s++)
+						temp3[s][t] = plaintexts[i][t + 4 * s] ^ plaintexts[j][t + 4 * s];
+				}
 
-		for (i = 0; i<4; i++)
+				numberCollision += (belongToU(temp3) > 0);
+			}
+		}
+
+		if (numberCollision > 0)
 		{
-			storeMemory[j][i] = inverseByteTransformation(v[i]);
+			*numberTests = k + 1;
+			*numberCollisions = numberCollision;
+			return 1;
 		}
+	}
 
-		storeMemory[j][0] ^= k1;/* StoreMemory is used to store the pre-computed values.It is of size 16*4 since there are 16 different values of v[0] and we need four nibbles one time */
-		storeMemory[j][1] ^= k2;
-		storeMemory[j][2] ^= k3;
-		storeMemory[j][3] ^= k4;
+	*numberTests = N_TEST;
+	*numberCollisions = 0;
+	return 0;
+}
 
-	}
+/*As chosenCiphertextTest, with the tests and the collisions in numberTestsDone and numberCollisionsDone*/
+
+int chosenCiphertextCollision(word8 g0, word8 g1, word8 g2, word8 g3, int a, word8 lastKey[][4], int number)/* use number to check whether it is the first collection */
+{
+	int result, numberCollision;
+	long int numberTests;
 
-	/*If it is the first collection,store the values of the 12 nibbles of each column*/
 	if (number == 1)
+		newConstants(4);
+
+	result = chosenCiphertextTest(g0, g1, g2, g3, a, lastKey, &numberTests, &numberCollision);
+	numberTestsDone = numberTests;
+	numberCollisionsDone = numberCollision;
+
+	return result;
+}
+
+/*Worker of the sweep: the candidate first + i is tested with the structures in order, until one has a collision. numberTests[i] is
+the sum of the tests, numberCollisions[i] the collisions of the last test, and structure[i] the structure that eliminated it
+(CHOSEN_CIPHERTEXT_STRUCTURES if it survives all of them)*/
+
+std::atomic<long long> nextCiphertextBlock;
+
+void chosenCiphertextWorker(word8 (*lastKey)[4], long long first, long long last, long int *numberTests, int *numberCollisions, int *structure){
+
+	long long block, g;
+	long int tests;
+	int a, collisions;
+
+	while ((block = nextCiphertextBlock.fetch_add(CHOSEN_CIPHERTEXT_BLOCK)) < last - first)
 	{
-		for (int i = 0; i < N_TEST; i++)
+		for (g = first + block; (g < first + block + CHOSEN_CIPHERTEXT_BLOCK) && (g < last); g++)
 		{
-			for (int j = 0; j < 12; j++)
+			numberTests[g - first] = 0;
+			numberCollisions[g - first] = 0;
+			for (a = 0; a < CHOSEN_CIPHERTEXT_STRUCTURES; a++)
 			{
-				constants[i][j] = randomByte();
+				if (chosenCiphertextTest((word8)(g >> 12), (word8)((g >> 8) & 0xf), (word8)((g >> 4) & 0xf), (word8)(g & 0xf), a, lastKey, &tests, &collisions) == 1)
+				{
+					numberTests[g - first] += tests;
+					numberCollisions[g - first] = collisions;
+					break;
+				}
+				numberTests[g - first] += tests;
 			}
+			structure[g - first] = a;
+			telemetryCandidate(numberTests[g - first], 16, a == CHOSEN_CIPHERTEXT_STRUCTURES);
 		}
 	}
+}
 
-	for (k = 0; k<N_TEST; k++)//We need about 2^11.7 tests
+/*Distinguisher on the candidates in [first, last) of the anti-diagonal 0 of the last round key (g0 in the most significant nibble),
+on nThreads threads: the records and the console follow the order of the candidates*/
+
+int distinguisherChosenCiphertext(word8 key[][4], long long first, long long last, int nThreads)
+{
+	int i, r, nnn, nSecond, right, *numberCollisions, *structure;
+	long int *numberTests;
+	long long g;
+	word8 lastKey[4][4];
+	std::thread *worker;
+
+	lastRoundKey(key, lastKey, N_Round);
+	right = 0;
+	for (r = 0; r < 4; r++)
+		right = (right << 4) | lastKey[r][antiDiagonalColumn(r, 0)];
+
+	numberTests = (long int *)malloc((size_t)(last - first) * sizeof(long int));
+	numberCollisions = (int *)malloc((size_t)(last - first) * sizeof(int));
+	structure = (int *)malloc((size_t)(last - first) * sizeof(int));
+
+	resetTelemetry(last - first);
+	resultBeginRun(RESULT_CHOSEN_CIPHERTEXT, 4, nThreads, first, last);
+
+	newConstants(4);
+	nextCiphertextBlock.store(0);
+	worker = new std::thread[nThreads];
+	for (i = 0; i < nThreads; i++)
+		worker[i] = std::thread(chosenCiphertextWorker, lastKey, first, last, numberTests, numberCollisions, structure);
+	for (i = 0; i < nThreads; i++)
+		worker[i].join();
+	delete[] worker;
+
+	nnn = 0;
+	nSecond = 0;
+	for (g = first; g < last; g++)
 	{
-		//plaintexts
-		int index[12] = { 1, 2, 3, 4, 6, 7, 8, 9, 11, 12, 13, 14 };
-		for (int j = 0; j < 16; j++){
-			for (int i = 0; i < 12; i++){
-				play[j][index[i]] = constants[k][i];
-			}
-		}
+		resultCandidate(g, 0, numberTests[g - first], numberCollisions[g - first], g == right, (structure[g - first] > 0) ? RESULT_SECOND_STRUCTURE : 0);
 
-		for (j = 0; j<16; j++)
+		if ((structure[g - first] == CHOSEN_CIPHERTEXT_STRUCTURES) && (results.console == 1))
 		{
-			play[j][0] = storeMemory[j][0];
-			play[j][5] = storeMemory[j][1];
-			play[j][10] = storeMemory[j][2];
-			play[j][15] = storeMemory[j][3];
+			printf("0x%x - 0x%x - 0x%x - 0x%x", (int)(g >> 12), (int)((g >> 8) & 0xf), (int)((g >> 4) & 0xf), (int)(g & 0xf));
+			if (g == right)
+				printf(" - Right Key!\n");
+			else
+				printf(" - Wrong Key!\n");
 		}
+		if (structure[g - first] == CHOSEN_CIPHERTEXT_STRUCTURES)
+			nnn++;
+		else if (structure[g - first] > 0)
+			nSecond++;
+	}
 
-		/*print the plaintexts*/
-		/*for (int i = 0; i < 16; i++){
-			for (int j = 0; j < 16; j++){
-				printf("0x%x ", play[i][j]);
-			}
-			printf("\n");
-		}
+	printf("Survivors: %d of %lld candidates (%d more survived the first structure and were eliminated by the second one)\n", nnn, last - first, nSecond);
+	resultEndRun(last - first, nnn);
 
-		system("pause");*/
+	free(numberTests);
+	free(numberCollisions);
+	free(structure);
 
-		/* After the above operation,we can get 16 different states of plaintexts,stored in the two-dimensional array play of size 16*16 */
+	if (nnn > 0)
+		return 0;
+	else
+		return 1;
+}
 
-		//ciphertexts
-		for (j = 0; j<16; j++)
-		{
-			for (i = 0; i<16; i++)
-			{
-				/////
-				/* orignal temp[i]=play[j][i]:*/
-				////
-				temp[i / 4][i % 4] = play[j][i];/* get the first state of plaintext */
-			}
-			encryption(temp, key, &(temp2[0]));/* encrypt the first state */
-			for (i = 0; i<16; i++)
-			{
-				cipher[j][i] = temp2[i];/* get the corresponding cipher */
-			}
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**SELF TEST:
+every faster implementation is checked bit for bit against the reference one:
+- mixColumn and partialInvMixColumn (tables) against the product by the matrix, on all the 2^16 columns;
+- encryptionFused against encryption, on edge cases and random inputs, plus known answers of encryption (default S-box and matrix);
+- encryptionAES8 (AES-NI and tables) against each other and against the AES-128 vector of FIPS-197;
+- belongToWPacked and collisionTest against belongToW;
+- the survivors of the pipelined distinguisher against the ones of newWay_contNumberCollisionAES, on the candidates in
+  [SELF_TEST_FIRST, SELF_TEST_LAST) (compile with a small N_TEST, e.g. -DN_TEST=256, for a quick run), and the budget of aes5Run
+  against aes5Budget (testBudget restored at the end);
+- the pipeline reading the first SELF_TEST_CACHE_TESTS tests from a ciphertext cache (built in two steps) against the pipeline
+  without cache;
+- the bitsliced multi-key encryption against encryption (64 random keys and plaintexts), and multiKeyCollisionTest against
+  encryptTest and collisionTest, key by key, on SELF_TEST_MULTI_KEY_TESTS tests;
+- decryption and decryptionFused against encryption, masterKey against lastRoundKey, and the chosen-ciphertext distinguisher by a
+  decryption oracle on the right candidate;
+- the structures of the chosen-ciphertext distinguisher: only the right guess survives all of them;
+- queryEncryption against encryption, with the same plaintexts asked with two keys in turn;
+- the truncated differentials (see selfTestTruncated);
+- encryptionCollision and collisionTestDiagonal against encryption and belongToW, pair by pair, on SELF_TEST_COLLISION_FORM tests.
+Note: the test vectors of "Small Scale Variants of the AES" are not in the repository, so the known answers of encryption are the
+outputs of this reference implementation (regression only).
+It returns the number of failed checks.
+*/
+
+#define SELF_TEST_RANDOM 1000000
+#define SELF_TEST_FIRST 0x0500
+#define SELF_TEST_LAST 0x0600
+#define SELF_TEST_SEED 5489UL
+#define SELF_TEST_CACHE_TESTS 16
+#define SELF_TEST_CACHE_FILE "AES_5RoundDistinguisher_selftest.cache" /* in TMPDIR (or /tmp), removed at the end */
+#define SELF_TEST_MULTI_KEY_TESTS 256
+#define SELF_TEST_COLLISION_FORM 20000
+#define SELF_TEST_FALSE_POSITIVE 1e-3
+
+/*encryption: 0 key and plaintext, 0xf key and plaintext, default key of main and plaintext (0x0, 0x1, ..., 0xf) row by row*/
+const word8 knownAnswer[3][16] = {
+	{ 0x7, 0x2, 0xb, 0x7, 0x1, 0x9, 0x8, 0x2, 0x3, 0xf, 0xf, 0x0, 0xe, 0xf, 0x0, 0xc },
+	{ 0x4, 0x5, 0x1, 0xb, 0xe, 0xd, 0x8, 0xd, 0x4, 0x9, 0x9, 0x6, 0x2, 0x7, 0x8, 0x8 },
+	{ 0x8, 0x5, 0x9, 0xc, 0x6, 0x9, 0xf, 0x5, 0x1, 0x2, 0x4, 0x9, 0xf, 0x6, 0x0, 0xd }
+};
+
+int selfTestResult(const char *name, int fail){
+
+	printf("%s: %s\n", name, (fail == 0) ? "OK" : "FAIL");
+
+	return (fail != 0);
+}
+
+/*Product of the matrix by a column (no tables)*/
+
+void referenceMatrixColumn(word8 matrix[][4], word8 *colonna, word8 *nuovaColonna){
+
+	int i, j;
+
+	for (i = 0; i < 4; i++){
+		nuovaColonna[i] = 0;
+		for (j = 0; j < 4; j++)
+			nuovaColonna[i] ^= multiplication(matrix[i][j], colonna[j]);
+	}
+}
+
+int selfTestLinearLayer(){
+
+	int value, i, j, fail = 0;
+	word8 state[16], colonna[4], v[4], expected[4];
+
+	for (value = 0; value < 65536; value++){
+
+		for (j = 0; j < 4; j++)
+			colonna[j] = (word8)((value >> (4 * j)) & 0xf);
+
+		//the same column in the four positions, with a different rotation
+		for (i = 0; i < 4; i++){
+			for (j = 0; j < 4; j++)
+				state[i + 4 * j] = colonna[(j + i) % 4];
+		}
+		mixColumn(state);
+		for (i = 0; i < 4; i++){
+			for (j = 0; j < 4; j++)
+				v[j] = colonna[(j + i) % 4];
+			referenceMatrixColumn(mixMatrix, v, expected);
+			for (j = 0; j < 4; j++)
+				fail |= (state[i + 4 * j] != expected[j]);
 		}
 
-		/* After the above operation,we can get 16 ciphers corresponding to the pre-computed random plaintexts */
+		for (j = 0; j < 4; j++)
+			v[j] = colonna[j];
+		partialInvMixColumn(v);
+		referenceMatrixColumn(invMixMatrix, colonna, expected);
+		referenceMatrixColumn(mixMatrix, v, state);
+		for (j = 0; j < 4; j++)
+			fail |= (v[j] != expected[j]) | (state[j] != colonna[j]);
+	}
 
-		for (i = 0; i<16; i++)
-		{
-			for (j = i + 1; j<16; j++)//To generate pairs
-			{
-				for (t = 0; t<4; t++)
-				{
-					for (s = 0; s<4; s++)
-					{
-						temp3[s][t] = cipher[i][s + 4 * t] ^ cipher[j][s + 4 * t];
-					}
-				}
+	return fail;
+}
 
-				numberCollision = belongToW(temp3);
+int selfTestEncryption(int defaultSPN){
 
-				if (numberCollision > 0)
-					return 1;
+	int t, i, j, fail = 0;
+	word8 p[4][4], k[4][4], c[16], c2[16];
+
+	//edge cases: 0 and 0xf, then one active nibble in the plaintext or in the key
+	for (t = 0; t < 2 + 2 * 16 * 15; t++){
+		for (i = 0; i < 16; i++){
+			p[i / 4][i % 4] = (t == 1) ? 0xf : 0x0;
+			k[i / 4][i % 4] = (t == 1) ? 0xf : 0x0;
+		}
+		if (t >= 2){
+			j = (t - 2) % (16 * 15);
+			if (t - 2 < 16 * 15)
+				p[(j / 15) / 4][(j / 15) % 4] = (word8)(1 + j % 15);
+			else
+				k[(j / 15) / 4][(j / 15) % 4] = (word8)(1 + j % 15);
+		}
+
+		encryption(p, k, c);
+		encryptionFused(p, k, c2);
+		fail |= (memcmp(c, c2, 16) != 0);
+	}
 
+	for (t = 0; t < SELF_TEST_RANDOM; t++){
+		for (i = 0; i < 16; i++){
+			p[i / 4][i % 4] = (word8)(genrand_int32() & 0xf);
+			k[i / 4][i % 4] = (word8)(genrand_int32() & 0xf);
+		}
+
+		encryption(p, k, c);
+		encryptionFused(p, k, c2);
+		fail |= (memcmp(c, c2, 16) != 0);
+	}
+
+	if (defaultSPN == 1){
+		for (t = 0; t < 3; t++){
+			for (i = 0; i < 16; i++){
+				p[i / 4][i % 4] = (t == 0) ? 0x0 : ((t == 1) ? 0xf : (word8)i);
+				k[i / 4][i % 4] = (t == 0) ? 0x0 : ((t == 1) ? 0xf : (word8)(4 * (i % 4) + i / 4));
 			}
+
+			encryption(p, k, c);
+			fail |= (memcmp(c, knownAnswer[t], 16) != 0);
 		}
 	}
 
-	return 0;
+	return fail;
 }
 
-int contNumberCollisionAES(word8 k1, word8 k2, word8 k3, word8 k4, word8 key[][4])
-{
-	int i, j, numberCollision, t, s;
-	word8 storeMemory[16][4], v[4], temp2[16], temp3[4][4];
-	///
-	/*define temp as a two-dimensional array of size 4*4 instead of an one-dimensional array of size 16 */
-	///
-	word8 temp[4][4];
+int selfTestAES8(){
 
-	long int k;
+	int t, i, fail = 0;
+	word8 p[4][4], k[4][4], c[16], c2[16], v[4], w[4];
+	const word8 fips197[16] = { 0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a };
+	int aesNIPresent;
 
-	//prepare the plaintexts
-	for (j = 0; j<16; j++)
-	{
-		v[0] = (word8)j;
-		v[1] = 0x0;
-		v[2] = 0x0;
-		v[3] = 0x0;
+	initializationAES8();
+	aesNIPresent = aesNI;
 
-		partialInvMixColumn(&(v[0]));
+	//FIPS-197, appendix C.1: the bytes of the vectors are column by column
+	for (i = 0; i < 16; i++){
+		k[i % 4][i / 4] = (word8)i;
+		p[i % 4][i / 4] = (word8)(0x11 * i);
+	}
+	for (t = 0; t <= aesNIPresent; t++){
+		aesNI = t;
+		encryptionAES8Rounds(p, k, c, 10);
+		for (i = 0; i < 16; i++)
+			fail |= (c[(i / 4) + 4 * (i % 4)] != fips197[i]);
+	}
 
-		for (i = 0; i<4; i++)
-		{
-			storeMemory[j][i] = inverseByteTransformation(v[i]);
+	for (t = 0; (t < SELF_TEST_RANDOM / 8) && (aesNIPresent == 1); t++){
+		for (i = 0; i < 16; i++){
+			p[i / 4][i % 4] = (word8)genrand_int32();
+			k[i / 4][i % 4] = (word8)genrand_int32();
 		}
 
-		storeMemory[j][0] ^= k1;/* StoreMemory is used to store the pre-computed values.It is of size 16*4 since there are 16 different values of v[0] and we need four nibbles one time */
-		storeMemory[j][1] ^= k2;
-		storeMemory[j][2] ^= k3;
-		storeMemory[j][3] ^= k4;
+		aesNI = 1;
+		encryptionAES8(p, k, c);
+		aesNI = 0;
+		encryptionAES8(p, k, c2);
+		fail |= (memcmp(c, c2, 16) != 0);
+	}
+	aesNI = aesNIPresent;
+
+	//partialInvMixColumnAES8 is the inverse of the MixColumns (2, 3, 1, 1) of te
+	for (t = 0; t < SELF_TEST_RANDOM / 8; t++){
+		for (i = 0; i < 4; i++)
+			v[i] = w[i] = (word8)genrand_int32();
+		partialInvMixColumnAES8(v);
+		for (i = 0; i < 4; i++)
+			fail |= (w[i] != (multiplication8(v[i], 2) ^ multiplication8(v[(i + 1) % 4], 3) ^ v[(i + 2) % 4] ^ v[(i + 3) % 4]));
+	}
+
+	return fail;
+}
 
+int selfTestCollision(){
+
+	int t, i, s, fail = 0, expected;
+	word8 d[16], temp3[4][4], ciphertexts[16][16];
+
+	//belongToWPacked: all the 2^16 patterns of zero nibbles
+	for (t = 0; t < 65536; t++){
+		for (i = 0; i < 16; i++)
+			d[i] = ((t >> i) & 0x1) ? 0x0 : (word8)(1 + genrand_int32() % 15);
+		for (i = 0; i < 16; i++)
+			temp3[i % 4][i / 4] = d[i];
+
+		fail |= (belongToW(temp3) != belongToWPacked(packState(d)));
 	}
 
-	for (k = 0; k<N_TEST; k++)//We need about 2^11.7 tests
-	{
-		//plaintexts
-		for (j = 0; j<16; j++)
-		{
-			play[0][j] = randomByte();
+	//collisionTest: random sets (with and without a forced collision)
+	for (t = 0; t < SELF_TEST_RANDOM / 64; t++){
+		for (i = 0; i < 16; i++){
+			for (s = 0; s < 16; s++)
+				ciphertexts[i][s] = (word8)(genrand_int32() & 0xf);
+		}
+		if (t & 0x1){
+			i = genrand_int32() % 15;
+			for (s = 0; s < 16; s++)
+				ciphertexts[i + 1][s] = ((s == 3) || (s == 6) || (s == 9) || (s == 12)) ? ciphertexts[i][s] : ciphertexts[i + 1][s];
+		}
 
-			for (i = 1; i<16; i++)
-			{
-				play[i][j] = play[0][j];
-			}
+		expected = 0;
+		for (i = 0; i < 16; i++){
+			for (s = i + 1; s < 16; s++)
+				expected |= belongToWPacked(packState(ciphertexts[i]) ^ packState(ciphertexts[s]));
 		}
-		for (j = 0; j<16; j++)
+
+		fail |= (collisionTest(ciphertexts) != expected) | ((t & 0x1) && (expected == 0));
+	}
+
+	return fail;
+}
+
+int selfTestDistinguisher(word8 key[][4]){
+
+	int fail = 0, nReference = 0, nLanes, i;
+	long long candidate, reference[SELF_TEST_LAST - SELF_TEST_FIRST];
+	long int previousBudget = testBudget;
+	double achievedFP, achievedFN;
+	aes5Config config = { 4, 1, 0, SELF_TEST_SEED, SELF_TEST_FALSE_POSITIVE, 0.0 };
+	aes5Range range = { SELF_TEST_FIRST, SELF_TEST_FIRST + 16 };
+	aes5RunBudget budget;
+
+	init_genrand(SELF_TEST_SEED);
+	for (candidate = SELF_TEST_FIRST; candidate < SELF_TEST_LAST; candidate++){
+		if (newWay_contNumberCollisionAES(candidateCell(candidate, 0), candidateCell(candidate, 1), candidateCell(candidate, 2), candidateCell(candidate, 3), key, candidate == SELF_TEST_FIRST) == 0)
+			reference[nReference++] = candidate;
+	}
+
+	for (nLanes = 1; nLanes <= 2; nLanes++){
+		init_genrand(SELF_TEST_SEED);
+		runPipeline(key, nLanes, SELF_TEST_FIRST, SELF_TEST_LAST);
+
+		fail |= (nSurvivor != nReference);
+		for (i = 0; (i < nStoredSurvivor) && (i < nReference); i++)
+			fail |= (survivor[i] != reference[i]);
+	}
+
+	//aes5Run returns the budget of aes5Budget, and testBudget goes back to its value
+	aes5SetKey(key);
+	fail |= (aes5Run(&config, &range, 1, NULL, 0, NULL, NULL, &budget) < 0);
+	fail |= (testBudget != previousBudget) || (budget.numberTests != aes5Budget(4, SELF_TEST_FALSE_POSITIVE, 0.0, &achievedFP, &achievedFN)) ||
+		(budget.falsePositive != achievedFP) || (budget.falseNegative != achievedFN);
+
+	printf("Survivors of the reference distinguisher: %d\n", nReference);
+
+	return fail;
+}
+
+int selfTestCache(word8 key[][4]){
+
+	int fail = 0, nReference, i, step;
+	long long reference[SELF_TEST_LAST - SELF_TEST_FIRST];
+	long int cacheWanted = (SELF_TEST_CACHE_TESTS < N_TEST) ? SELF_TEST_CACHE_TESTS : N_TEST;
+	char fileName[1024];
+	const char *directory = getenv("TMPDIR");
+
+#if defined(__unix__) || defined(__APPLE__)
+	snprintf(fileName, sizeof(fileName), "%s/%d_" SELF_TEST_CACHE_FILE, (directory != NULL) ? directory : "/tmp", (int)getpid());
+#else
+	snprintf(fileName, sizeof(fileName), "%s", SELF_TEST_CACHE_FILE);
+#endif
+
+	init_genrand(SELF_TEST_SEED);
+	runPipeline(key, 2, SELF_TEST_FIRST, SELF_TEST_LAST);
+	nReference = nSurvivor;
+	memcpy(reference, survivor, nStoredSurvivor * sizeof(long long));
+
+	//incremental build: half of the tests, then the other half - after a cut in the middle of the last block of the first half
+	remove(fileName);
+	for (step = 1; (step <= 2) && (fail == 0); step++)
+	{
+		fail |= cacheBuild(fileName, key, SELF_TEST_SEED, cacheWanted * step / 2, 2);
+#if defined(__unix__) || defined(__APPLE__)
+		if ((step == 1) && (fail == 0) && (cacheWanted >= 2))
 		{
-			play[j][0] = storeMemory[j][0];
-			play[j][5] = storeMemory[j][1];
-			play[j][10] = storeMemory[j][2];
-			play[j][15] = storeMemory[j][3];
+			cacheClose();
+			fail |= (truncate(fileName, CACHE_HEADER_SIZE + (cacheWanted / 2 - 1) * CACHE_BLOCK + CACHE_BLOCK / 2) != 0);
 		}
-		/* After the above operation,we can get 16 different states of plaintexts,stored in the two-dimensional array play of size 16*16 */
+#endif
+	}
+	fail |= (cacheInfo.built != (word64)cacheWanted);
 
-		//ciphertexts
-		for (j = 0; j<16; j++)
-		{
-			for (i = 0; i<16; i++)
-			{
-				/////
-				/* orignal temp[i]=play[j][i]:*/
-				////
-				temp[i / 4][i % 4] = play[j][i];/* get the first state of plaintext */
-			}
-			encryption(temp, key, &(temp2[0]));/* encrypt the first state */
-			for (i = 0; i<16; i++)
+	if (fail == 0)
+	{
+		cacheTests = (long int)cacheInfo.built;
+		init_genrand(SELF_TEST_SEED);
+		runPipeline(key, 2, SELF_TEST_FIRST, SELF_TEST_LAST);
+
+		fail |= (nSurvivor != nReference);
+		for (i = 0; (i < nStoredSurvivor) && (i < nReference); i++)
+			fail |= (survivor[i] != reference[i]);
+	}
+
+	cacheClose();
+	remove(fileName);
+
+	return fail;
+}
+
+int selfTestMultiKey(){
+
+	int fail = 0, i, j, l, candidates[MULTI_KEY_LANES];
+	long int k, numberTests, eliminatedAt[MULTI_KEY_LANES], reference;
+	word8 keys[MULTI_KEY_LANES][4][4], plaintexts[MULTI_KEY_LANES][4][4], temp2[16], temp3[16], storeMemory[16][4], ciphertexts[16][16];
+	word64 keyPlanes[16][4], roundKey[N_Round + 1][16][4], state[16][4];
+
+	initializationSlice();
+
+	for (l = 0; l < MULTI_KEY_LANES; l++)
+	{
+		for (i = 0; i < 4; i++)
+		{
+			for (j = 0; j < 4; j++)
 			{
-				cipher[j][i] = temp2[i];/* get the corresponding cipher */
+				keys[l][i][j] = randomByte();
+				plaintexts[l][i][j] = randomByte();
 			}
 		}
-		/* After the above operation,we can get 16 ciphers corresponding to the pre-computed random plaintexts */
+		candidates[l] = (l % 2 == 0) ? ((keys[l][0][0] << 12) | (keys[l][1][1] << 8) | (keys[l][2][2] << 4) | keys[l][3][3]) : (int)(genrand_int31() & 0xffff);
+	}
 
-		for (i = 0; i<16; i++)
-		{
-			for (j = i + 1; j<16; j++)//To generate pairs
-			{
-				for (t = 0; t<4; t++)
-				{
-					for (s = 0; s<4; s++)
-					{
-						temp3[s][t] = cipher[i][s + 4 * t] ^ cipher[j][s + 4 * t];
-					}
-				}
+	sliceKeys(keys, MULTI_KEY_LANES, keyPlanes);
+	sliceExpandKey(keyPlanes, roundKey);
+	sliceKeys(plaintexts, MULTI_KEY_LANES, state);
+	sliceEncryption(state, roundKey);
 
-				numberCollision = belongToW(temp3);
+	for (l = 0; l < MULTI_KEY_LANES; l++)
+	{
+		encryption(plaintexts[l], keys[l], &(temp2[0]));
+		unsliceState(state, l, &(temp3[0]));
+		fail |= (memcmp(temp2, temp3, 16) != 0);
+	}
 
-				if (numberCollision > 0)
-					return 1;
+	numberTests = (SELF_TEST_MULTI_KEY_TESTS < N_TEST) ? SELF_TEST_MULTI_KEY_TESTS : N_TEST;
+	generateConstants();
+	multiKeyCollisionTest(keys, candidates, MULTI_KEY_LANES, numberTests, eliminatedAt);
+
+	for (l = 0; l < MULTI_KEY_LANES; l++)
+	{
+		prepareStoreMemory((word8)(candidates[l] >> 12), (word8)((candidates[l] >> 8) & 0xf), (word8)((candidates[l] >> 4) & 0xf), (word8)(candidates[l] & 0xf), storeMemory);
 
+		reference = numberTests;
+		for (k = 0; k < numberTests; k++)
+		{
+			encryptTest(storeMemory, k, keys[l], ciphertexts);
+			if (collisionTest(ciphertexts) > 0)
+			{
+				reference = k + 1;
+				break;
 			}
 		}
+
+		fail |= (eliminatedAt[l] != reference);
 	}
 
-	return 0;
+	return fail;
+}
 
+/*decryption and decryptionFused against encryption, masterKey against lastRoundKey; then the chosen-ciphertext distinguisher by a
+decryption oracle against the one by decryptionFused on 16 candidates with each structure (same constants), and the right candidate
+survives all of them*/
+
+void selfTestDecryptionOracle(word8 ciphertext[][4], word8 *plaintext, void *context){
+
+	decryption(ciphertext, (word8 (*)[4])context, plaintext);
 }
 
-/**RANDOM PERMUTATION CASE:
-for a fixed combination of delta0, delta1, delta2, delta3, it generates the corresponding collection, that is sets of plaintexts
-W_\Delta and the corresponding ciphertexts.
-For simplicity, the ciphertexts are generated in a random way.
-Then it counts the number of collision in M.
+int selfTestDecryption(word8 key[][4]){
 
-It returns 1 if there is at least one collision; 0 otherwise.*/
+	int t, i, r, right, g, number, fail = 0;
+	word8 p[4][4], k[4][4], c[16], c2[4][4], p2[16], lastKey[4][4], k2[4][4];
 
-int contNumberCollisionRandom()
-{
-	word8 temp3[4][4], temp[4][4];
+	for (t = 0; t < SELF_TEST_RANDOM; t++){
+		for (i = 0; i < 16; i++){
+			p[i / 4][i % 4] = (word8)(genrand_int32() & 0xf);
+			k[i / 4][i % 4] = (word8)(genrand_int32() & 0xf);
+		}
 
-	long int i;
+		encryption(p, k, c);
+		for (i = 0; i < 16; i++)
+			c2[i / 4][i % 4] = c[i];
+		lastRoundKey(k, lastKey, N_Round);
 
-	int l, k, j, t, s, numberCollision;
-	int flag2, flag;
+		decryption(c2, lastKey, p2);
+		fail |= (memcmp(p, p2, 16) != 0);
+		decryptionFused(c2, lastKey, p2);
+		fail |= (memcmp(p, p2, 16) != 0);
 
-	for (i = 0; i<N_TEST; i++)
+		masterKey(lastKey, k2, N_Round);
+		fail |= (memcmp(k, k2, 16) != 0);
+	}
+
+	lastRoundKey(key, lastKey, N_Round);
+	right = 0;
+	for (r = 0; r < 4; r++)
+		right = (right << 4) | lastKey[r][antiDiagonalColumn(r, 0)];
+
+	for (t = 0; t < 16 * CHOSEN_CIPHERTEXT_STRUCTURES; t++){
+		g = right ^ (t / CHOSEN_CIPHERTEXT_STRUCTURES);
+
+		aes5SetDecryptionOracle(selfTestDecryptionOracle, lastKey);
+		number = chosenCiphertextCollision((word8)(g >> 12), (word8)((g >> 8) & 0xf), (word8)((g >> 4) & 0xf), (word8)(g & 0xf), t % CHOSEN_CIPHERTEXT_STRUCTURES, NULL, t == 0);
+		aes5SetDecryptionOracle(NULL, NULL);
+
+		fail |= (chosenCiphertextCollision((word8)(g >> 12), (word8)((g >> 8) & 0xf), (word8)((g >> 4) & 0xf), (word8)(g & 0xf), t % CHOSEN_CIPHERTEXT_STRUCTURES, lastKey, 0) != number);
+		if (g == right)
+			fail |= (number != 0);
+	}
+
+	return fail;
+}
+
+/*The guesses right ^ d that survive a structure of the chosen-ciphertext distinguisher, without decryptions: the inverse of the last
+round and of the MixColumns of the round N_Round - 1 on the 16 columns of the structure of the row a, with the guess wrong by d,
+gives columns that differ in one row at most. With the default S-box each structure has 16 of them (see the NOTE of CHOSEN-CIPHERTEXT
+DISTINGUISHER), and only d = 0 is in all of them*/
+
+int selfTestChosenCiphertextStructures(){
+
+	int a, d, v, r, fail = 0, nEquivalent[CHOSEN_CIPHERTEXT_STRUCTURES], nCommon = 0;
+	unsigned short column[16], difference;
+	int equivalent;
+
+	for (a = 0; a < CHOSEN_CIPHERTEXT_STRUCTURES; a++)
+		nEquivalent[a] = 0;
+
+	for (d = 0; d < N_CANDIDATES; d++)
 	{
-		//produce random ciphertexts - it is a random Permutation!
-		for (j = 0; j<16; j++)// procedure a two-dimensional array cipher[16][16],assigned with random value and each row differs from each other.
+		equivalent = 1;
+		for (a = 0; a < CHOSEN_CIPHERTEXT_STRUCTURES; a++)
 		{
-			do
+			difference = 0;
+			for (v = 0; v < 16; v++)
 			{
-				flag2 = 0;
+				column[v] = 0;
+				for (r = 0; r < 4; r++)
+					column[v] ^= invSBoxMixTable[r][byteTransformation((word8)((mixTable[a][v] >> (4 * r)) & 0xf)) ^ ((d >> (4 * (3 - r))) & 0xf)];
+				difference |= column[v] ^ column[0];
+			}
 
-				//get 16 elements,assigned to temp
-				for (k = 0; k<4; k++)
-				{
-					for (l = 0; l<4; l++)
-						temp[l][k] = randomByte();//assign random values to temp[4][4]
-				}
+			for (r = 0; (r < 4) && ((difference & ~(0xf << (4 * r))) != 0); r++);
+			if (r < 4)
+				nEquivalent[a]++;
+			else
+				equivalent = 0;
+		}
+		nCommon += equivalent;
+	}
 
+	for (a = 0; a < CHOSEN_CIPHERTEXT_STRUCTURES; a++)
+		fail |= (nEquivalent[a] < 1);
+	fail |= (nCommon != 1);
 
-				for (t = 0; ((t<j) && (j>0)); t++)
-				{
-					flag = 0;
-					for (k = 0; k<4; k++)
-					{
-						for (l = 0; l<4; l++)
-						{
-							if (temp[l][k] == cipher[t][l + 4 * k])//cipher is a two-dimensional array of size 16*16
-								flag++;
-						}
-					}
+	return fail;
+}
 
-					if (flag == 16)
-						flag2 = 1;
+/*encryptionCollision against encryption: on SELF_TEST_COLLISION_FORM tests (random key, candidate and constants), the collisions of
+each pair of ciphertexts of encryption (belongToW) and of the states of encryptionCollision (equal 16-bit lane) are the same, and
+so collisionTest and collisionTestDiagonal*/
 
-				}
+int selfTestCollisionForm(){
 
-				if (flag2 == 0)//The 16 elements in temp[4][4] has not been contained in any row of the cipher[0-(j-1)][16]
-				{
-					for (k = 0; k<4; k++)
-					{
-						for (l = 0; l<4; l++)
-						{
-							cipher[j][l + 4 * k] = temp[l][k];//assign the 16 values in temp[4][4] to the j-th row of cipher
-						}
-					}
-				}
-			} while (flag2 == 1);
+	int t, i, j, l, s, fail = 0, collisions = 0, w;
+	word8 key[4][4], storeMemory[16][4], temp[4][4], temp3[4][4], ciphertexts[16][16], states[16][16], testConstant[12];
+	int index[12] = { 1, 2, 3, 4, 6, 7, 8, 9, 11, 12, 13, 14 };
+	long int k;
+	word64 d;
+
+	selectCipher(4);
+	newConstants(4);
+
+	for (t = 0; t < SELF_TEST_COLLISION_FORM; t++){
+		for (i = 0; i < 16; i++)
+			key[i / 4][i % 4] = (word8)(genrand_int32() & 0xf);
+		prepareStoreMemory((word8)(genrand_int32() & 0xf), (word8)(genrand_int32() & 0xf), (word8)(genrand_int32() & 0xf), (word8)(genrand_int32() & 0xf), storeMemory);
+		k = (long int)(genrand_int32() % N_TEST);
+
+		//ciphertexts by encryption
+		testConstants(k, testConstant);
+		for (i = 0; i < 12; i++)
+			temp[index[i] / 4][index[i] % 4] = testConstant[i];
+		for (j = 0; j < 16; j++){
+			for (i = 0; i < 4; i++)
+				temp[i][i] = storeMemory[j][i];
+			encryption(temp, key, &(ciphertexts[j][0]));
 		}
 
-		for (l = 0; l<16; l++)
-		{
-			for (j = l + 1; j<16; j++)
-			{
-				for (t = 0; t<4; t++)
-				{
-					for (s = 0; s<4; s++)
-					{
-						temp3[s][t] = cipher[l][s + 4 * t] ^ cipher[j][s + 4 * t];
-					}
-				}
-
-				numberCollision = belongToW(temp3);
+		encryptTestCollision(storeMemory, k, key, states);
 
-				if (numberCollision > 0)
-					return 1;
+		for (i = 0; i < 16; i++){
+			for (j = i + 1; j < 16; j++){
+				for (l = 0; l < 4; l++){
+					for (s = 0; s < 4; s++)
+						temp3[s][l] = ciphertexts[i][s + 4 * l] ^ ciphertexts[j][s + 4 * l];
+				}
+				w = belongToW(temp3);
+				collisions += w;
 
+				d = packState(&(states[i][0])) ^ packState(&(states[j][0]));
+				fail |= (w != (((d & 0xffffULL) == 0) || ((d & 0xffff0000ULL) == 0) || ((d & 0xffff00000000ULL) == 0) || ((d & 0xffff000000000000ULL) == 0)));
 			}
 		}
+
+		fail |= (collisionTest(ciphertexts) != collisionTestDiagonal(states));
 	}
 
-	return 0;
+	//the check has to meet some collisions
+	fail |= (collisions == 0);
 
+	return fail;
 }
 
-/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/*Set of the queries: the same plaintexts with two keys in turn, against encryption (a ciphertext of the other key is never served)*/
 
-/**
-The following function implements the distinguisher for 5 rounds.
-In particular, if var = 0, it generates the set of plaintexts-ciphertexts using the AES mode, and checks that it is AES.
-If var = 1, it generates the set of plaintexts-ciphertexts using the random mode, and checks that it is a random permutation.
-*/
-int distinguisher5Rounds(word8 key[][4], int var)
-{
-	int k1, k2, k3, k4, number, nnn;
-	word8 kk1, kk2, kk3, kk4;
-	bool first = true;
+int selfTestQueries(){
 
-	nnn = 0;
+	int t, i, fail = 0;
+	word8 keys[2][4][4], plaintexts[16][4][4], temp2[16], temp3[16];
 
-	for (k1 = 0; k1<16; k1++)
-	{
-		//printf("%d\n", k1);
-		kk1 = (word8)k1;
-		for (k2 = 0; k2 <16; k2++)
-		{
-			kk2 = (word8)k2;
-			for (k3 = 0; k3<16; k3++)
-			{
-				kk3 = (word8)k3;
-				for (k4 = 0; k4 <16; k4++)
-				{
-					kk4 = (word8)k4;
+	for (i = 0; i < 16; i++){
+		keys[0][i / 4][i % 4] = (word8)(genrand_int32() & 0xf);
+		keys[1][i / 4][i % 4] = keys[0][i / 4][i % 4] ^ (word8)((i == 5) ? 0x1 : 0x0);
+	}
+	for (t = 0; t < 16; t++){
+		for (i = 0; i < 16; i++)
+			plaintexts[t][i / 4][i % 4] = (word8)(genrand_int32() & 0xf);
+	}
 
-					/*if (var == 0)
-						number = contNumberCollisionAES(kk1, kk2, kk3, kk4, key);// for each 4 diffrent nibbles of key,check whether it is true or not*/
+	fail |= startQueries(4);
+	for (t = 0; (t < 64) && (fail == 0); t++){
+		queryEncryption(plaintexts[t % 16], keys[(t / 16) % 2], temp2);
+		encryption(plaintexts[t % 16], keys[(t / 16) % 2], temp3);
+		fail |= (memcmp(temp2, temp3, 16) != 0);
+	}
+	fail |= (queries.queries != 64) || (queries.distinct != 64);
+	stopQueries();
 
-					//////
-					/* use different strategy since we use different ways to choose plaintexts */
-					//////
-					if (var == 0)
-					{
-						if (first)
-						{
-							number = newWay_contNumberCollisionAES(kk1, kk2, kk3, kk4, key, 1);// for each 4 diffrent nibbles of key,check whether it is true or not
-							first = false;
-						}
-						else
-							number = newWay_contNumberCollisionAES(kk1, kk2, kk3, kk4, key, 0);// for each 4 diffrent nibbles of key,check whether it is true or not
-					}
-					///
-					/* END */
-					///
+	return fail;
+}
 
-					else
-						number = contNumberCollisionRandom();
+/*Truncated differentials: the transitions of a column are distributions, a nonzero difference never becomes zero, the right key
+has one active nibble after the round 1 and no collision on 5 rounds (impossible differential), the wrong ones have collisions, and
+the estimate of a test agrees with the collisions of the cipher (truncatedMeasure)*/
 
-					if (number == 0)
-					{
-						nnn++;
-						printf("0x%x - 0x%x - 0x%x - 0x%x", k1, k2, k3, k4);
-						if ((k1 == key[0][0]) && (k2 == key[1][1]) && (k3 == key[2][2]) && (k4 == key[3][3]))
-							printf(" - Right Key!\n");
-						else
-							printf(" - Wrong Key!\n");
-					}
-				}
-			}
-		}
+int selfTestTruncated(word8 key[][4]){
+
+	int a, b, fail = 0;
+	double sum, measured, sigma;
+
+	truncatedAnalysis(2);
+
+	for (a = 0; a < 16; a++){
+		sum = 0.0;
+		for (b = 0; b < 16; b++)
+			sum += truncatedColumn[a][b];
+		fail |= (fabs(sum - 1.0) > 1e-9);
+		fail |= ((a != 0) && (truncatedColumn[a][0] != 0.0));
 	}
 
-	if (nnn > 0)
-		return 0;
-	else
-		return 1;
+	fail |= (truncatedFirstRound[0][0x1] != 1.0);
+	fail |= (truncatedPair[5][0] != 0.0);
+	for (a = 1; a < 16; a++)
+		fail |= (truncatedPair[5][a] <= 0.0);
+
+	fail |= (fabs(truncatedMeasure(key, &measured, &sigma)) > TRUNCATED_SIGMAS);
+
+	return fail;
+}
+
+int selfTest(word8 key[][4], int defaultSPN){
+
+	int failed = 0;
+
+	init_genrand(SELF_TEST_SEED);
+
+	failed += selfTestResult("mixColumn / partialInvMixColumn", selfTestLinearLayer());
+	failed += selfTestResult("encryptionFused", selfTestEncryption(defaultSPN));
+	failed += selfTestResult("encryptionAES8", selfTestAES8());
+	failed += selfTestResult("belongToWPacked / collisionTest", selfTestCollision());
+	failed += selfTestResult("pipelined distinguisher", selfTestDistinguisher(key));
+	failed += selfTestResult("ciphertext cache", selfTestCache(key));
+	failed += selfTestResult("multi-key bitsliced encryption", selfTestMultiKey());
+	failed += selfTestResult("decryption / chosen-ciphertext distinguisher", selfTestDecryption(key));
+	failed += selfTestResult("chosen-ciphertext structures", selfTestChosenCiphertextStructures());
+	failed += selfTestResult("queryEncryption", selfTestQueries());
+	failed += selfTestResult("truncated differentials", selfTestTruncated(key));
+	failed += selfTestResult("encryptionCollision / collisionTestDiagonal", selfTestCollisionForm());
+
+	return failed;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-/**DISTINGUISHER ON 5 ROUNDS - SECRET KEY */
+/**DISTINGUISHER ON 5 ROUNDS - SECRET KEY
+
+Usage: AES_5RoundDistinguisher [-spn file] [-selftest] [-pipeline nLanes] [-byte] [-range first last] [-fullkey]
+[-stats file] [-http port] [-period seconds] [-json file] [-bin file] [-all] [-verbose] [-seed seed]
+[-cache file] [-cachetests n] [-fp rate] [-fn rate] [-multikey nKeys] [-profile nCandidates] [-integral a maxSets]
+[-data nCandidates] [-decrypt] [-analysis]
+-selftest: checks the optimized implementations against the reference ones (see selfTest), and exits.
+-spn file: S-box and MixColumns matrix of the small scale cipher (see loadSPNVariant).
+-pipeline nLanes: the AES step runs on nLanes pairs of generator/checker threads (see distinguisher5RoundsPipeline).
+-byte: full AES (bytes) instead of the small scale AES - only with -pipeline, the serial drivers are for nibbles only (see CIPHER
+OF THE DISTINGUISHER). The run is refused if N_TEST tests cannot separate the candidates of -range (one wrong survivor expected, or
+the rate of -fp).
+-range first last: only the candidates in [first, last), in hexadecimal (k1 is the most significant cell) - only with -pipeline
+or -decrypt.
+-fullkey: the AES step recovers the whole round-0 key (see fullKeyRecovery) - small scale AES only.
+-stats file: publishes the progress of the sweep in file (JSON, see TELEMETRY) every -period seconds (default 10).
+-http port: publishes the progress on http://127.0.0.1:port/ too.
+-json file, -bin file: appends the results to file, as JSON lines or binary records (see RESULT SINK) - the console shows only
+a summary, unless -verbose.
+-all: records the eliminated candidates too, not only the survivors.
+-seed seed: seed of the random generator (default: the time), for runs that can be repeated.
+-cache file: the pipeline reads the ciphertexts from the cache file (see CIPHERTEXT CACHE), after extending it to -cachetests n tests
+(default N_TEST) - it needs the same key and -seed of the runs that built it.
+-fp rate, -fn rate: the pipeline uses the adaptive budget of tests for these false positive / false negative rates (see ADAPTIVE
+TEST BUDGET), instead of N_TEST - with -fp, -pipeline is 1 lane if not given.
+-multikey nKeys: success probability of the distinguisher over nKeys random keys, 64 keys at once (see MULTI-KEY BITSLICED
+ENCRYPTION and multiKeyExperiment) on -pipeline nLanes threads (default: all the cores) - small scale AES only.
+-profile nCandidates: hardware counters of the phases of the reference distinguisher on the first nCandidates candidates, in the AES
+and in the random case, and of the backends (lane of the pipeline, bitsliced) on the same candidates - one thread (see PROFILING).
+-integral a maxSets: integral attack on N_Round + 1 rounds, anti-diagonal a of the last round key with partial sums, at most maxSets
+sets of 2^16 plaintexts, on -pipeline nLanes threads (default: all the cores) - see integralKeyRecovery.
+-data nCandidates: distinct chosen plaintexts against total encryptions of the reference distinguisher on nCandidates candidates in
+a random order (the same for both strategies), with the shared constants and with new plaintexts for each test (see ORACLE QUERIES
+and dataComplexity).
+-decrypt: the distinguisher with chosen ciphertexts, on the anti-diagonal 0 of the last round key, with two structures (see
+CHOSEN-CIPHERTEXT DISTINGUISHER) on -pipeline nLanes threads (default: all the cores) - small scale AES only.
+-analysis: Markov-model estimates of the probabilities of collision of the truncated differentials on 4 and 5 rounds, by class of
+key, for the S-box and the matrix (see TRUNCATED DIFFERENTIALS), checked against the rate measured on the cipher with the secret key
+- the adaptive budgets of -fp use them.
+The program is a client of the library interface (see AES_5RoundDistinguisher.h): compile with -DAES5_LIBRARY to leave out main.
+*/
+
+}
+
+#ifndef AES5_LIBRARY
 
-int main()
+int main(int argc, char *argv[])
 {
 	FILE *fp;
 
@@ -1072,30 +5915,248 @@ int main()
 		0x3, 0x7, 0xb, 0xf
 	};
 
-	int j, k, result;
+	word8 recoveredKey[4][4];
+
+	int j, k, result, nLanes = 0, fullKey = 0, bits = 4, test = 0;
+	char *statsFile = NULL;
+	int port = 0;
+	double period = 10.0;
+	long long first = 0, last = -1;
+	char *spnFile = NULL;
+	char *jsonFile = NULL, *binaryFile = NULL;
+	int verbose = 0;
+	unsigned long seed = (unsigned long)time(NULL);
+	char *cacheFile = NULL;
+	long int cacheTestsWanted = 0;
+	double falsePositive = 0.0, falseNegative = 0.0, measured, sigma, deviation;
+	int nKeys = 0, nProfile = 0, integralDiagonal = -1, maxSets = 0, nData = 0, chosenCiphertext = 0, analysis = 0;
+	double achievedFP, achievedFN;
+
+	for (k = 1; k < argc; k++)
+	{
+		if ((strcmp(argv[k], "-pipeline") == 0) && (k + 1 < argc))
+			nLanes = atoi(argv[++k]);
+		else if (strcmp(argv[k], "-fullkey") == 0)
+			fullKey = 1;
+		else if (strcmp(argv[k], "-byte") == 0)
+			bits = 8;
+		else if ((strcmp(argv[k], "-spn") == 0) && (k + 1 < argc))
+			spnFile = argv[++k];
+		else if (strcmp(argv[k], "-selftest") == 0)
+			test = 1;
+		else if ((strcmp(argv[k], "-stats") == 0) && (k + 1 < argc))
+			statsFile = argv[++k];
+		else if ((strcmp(argv[k], "-http") == 0) && (k + 1 < argc))
+			port = atoi(argv[++k]);
+		else if ((strcmp(argv[k], "-period") == 0) && (k + 1 < argc))
+			period = atof(argv[++k]);
+		else if ((strcmp(argv[k], "-json") == 0) && (k + 1 < argc))
+			jsonFile = argv[++k];
+		else if ((strcmp(argv[k], "-bin") == 0) && (k + 1 < argc))
+			binaryFile = argv[++k];
+		else if (strcmp(argv[k], "-all") == 0)
+			results.all = 1;
+		else if (strcmp(argv[k], "-verbose") == 0)
+			verbose = 1;
+		else if ((strcmp(argv[k], "-seed") == 0) && (k + 1 < argc))
+			seed = strtoul(argv[++k], NULL, 0);
+		else if ((strcmp(argv[k], "-cache") == 0) && (k + 1 < argc))
+			cacheFile = argv[++k];
+		else if ((strcmp(argv[k], "-cachetests") == 0) && (k + 1 < argc))
+			cacheTestsWanted = atol(argv[++k]);
+		else if ((strcmp(argv[k], "-fp") == 0) && (k + 1 < argc))
+			falsePositive = atof(argv[++k]);
+		else if ((strcmp(argv[k], "-fn") == 0) && (k + 1 < argc))
+			falseNegative = atof(argv[++k]);
+		else if ((strcmp(argv[k], "-multikey") == 0) && (k + 1 < argc))
+			nKeys = atoi(argv[++k]);
+		else if ((strcmp(argv[k], "-profile") == 0) && (k + 1 < argc))
+			nProfile = atoi(argv[++k]);
+		else if ((strcmp(argv[k], "-data") == 0) && (k + 1 < argc))
+			nData = atoi(argv[++k]);
+		else if (strcmp(argv[k], "-decrypt") == 0)
+			chosenCiphertext = 1;
+		else if (strcmp(argv[k], "-analysis") == 0)
+			analysis = 1;
+		else if ((strcmp(argv[k], "-integral") == 0) && (k + 2 < argc))
+		{
+			integralDiagonal = atoi(argv[++k]) & 0x3;
+			maxSets = atoi(argv[++k]);
+		}
+		else if ((strcmp(argv[k], "-range") == 0) && (k + 2 < argc))
+		{
+			first = strtoll(argv[++k], NULL, 16);
+			last = strtoll(argv[++k], NULL, 16);
+		}
+	}
+
+	if (aes5Init(spnFile, seed) != 0)
+		return (1);
+
+	if ((falsePositive > 0.0) && (nLanes == 0) && (nKeys == 0))
+		nLanes = 1;
+
+	//the AES (bytes) has only the pipelined distinguisher
+	if ((bits == 8) && ((nLanes == 0) || (fullKey == 1) || (integralDiagonal >= 0) || (chosenCiphertext == 1) ||
+		(nData > 0) || (nProfile > 0) || (nKeys > 0)))
+	{
+		printf("Error: -byte works only with -pipeline, the full AES is pipeline-only (not with -fullkey, -integral, -decrypt, -data, -profile, -multikey).\n");
+		return (1);
+	}
 
-	srand(time(NULL));
+	selectCipher(bits);
+	if (last < 0)
+		last = 1LL << (4 * cellBits);
 
-	unsigned long init[4], length = 4;
-	init_by_array(init, length);
+	srand(seed);
 
 	//I want to work with 4 bits, not 8!
-	for (k = 0; k<4; k++)
+	for (k = 0; (k<4) && (cellBits == 4); k++)
 	{
 		for (j = 0; j<4; j++)
 			key[j][k] = key[j][k] & 0x0f;
 	}
 
+	if (test == 1)
+	{
+		selectCipher(4);
+		return (selfTest(key, spnFile == NULL) == 0) ? 0 : 1;
+	}
+
+	if (analysis == 1)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		truncatedUpdate();
+		printTruncatedAnalysis();
+		deviation = truncatedMeasure(key, &measured, &sigma);
+		printf("Measured on %d rounds (%d tests of wrong candidates): %.6e, estimate %.6e (%.1f standard deviations)\n", N_Round,
+			TRUNCATED_SAMPLE_TESTS, measured, ((N_Round >= 4) && (N_Round <= 5)) ? truncatedTest[N_Round] : 0.0, deviation);
+		if (fabs(deviation) > TRUNCATED_SIGMAS)
+			printf("Warning: the Markov-model estimate does not match the cipher - the adaptive budgets of -fp are not reliable.\n");
+		printf("Analysis: %.2f s\n", std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+		return (0);
+	}
+
 	printf("Secret Key Distinguisher for 5 Rounds Small Scale AES.\n\n");
 
 	printf("It works as follow: for each one of the 2^32 possible values of Delta (i.e. for each collection), it generates ");
 	printf("%d different W_\Delta sets (each one with 2^8 texts). Then it checks if there is at least one collision.\n\n", N_TEST);
 
+	if (resultOpen(jsonFile, binaryFile) != 0)
+		return (1);
+	if (((jsonFile != NULL) || (binaryFile != NULL)) && (verbose == 0))
+		results.console = 0;
+
+	if ((statsFile != NULL) || (port > 0))
+		startTelemetry(statsFile, port, period);
+
+	if ((integralDiagonal >= 0) && (cellBits == 4))
+	{
+		printf("Integral attack on %d rounds: anti-diagonal %d of the last round key.\n", N_Round + 1, integralDiagonal);
+
+		if (nLanes == 0)
+			nLanes = ((int)std::thread::hardware_concurrency() > 0) ? (int)std::thread::hardware_concurrency() : 1;
+		integralKeyRecovery(key, integralDiagonal, maxSets, nLanes);
+
+		stopTelemetry();
+		resultClose();
+		return (0);
+	}
+
+	if ((chosenCiphertext == 1) && (cellBits == 4))
+	{
+		printf("Chosen ciphertexts: anti-diagonal 0 of the last round key.\n");
+
+		if (nLanes == 0)
+			nLanes = ((int)std::thread::hardware_concurrency() > 0) ? (int)std::thread::hardware_concurrency() : 1;
+		result = distinguisherChosenCiphertext(key, first, last, nLanes);
+
+		printf("Result:\n");
+		if (result == 0)
+			printf("\t AES\n\n");
+		else
+			printf("\t Something Fail...\n\n");
+
+		stopTelemetry();
+		resultClose();
+		return (0);
+	}
+
+	if ((nData > 0) && (cellBits == 4))
+	{
+		dataComplexity(key, (nData < N_CANDIDATES) ? nData : N_CANDIDATES);
+
+		stopTelemetry();
+		resultClose();
+		return (0);
+	}
+
+	if ((nProfile > 0) && (cellBits == 4))
+	{
+		profileDistinguisher(key, (nProfile < N_CANDIDATES) ? nProfile : N_CANDIDATES);
+		profileBackends(key, (nProfile < N_CANDIDATES) ? nProfile : N_CANDIDATES);
+
+		stopTelemetry();
+		resultClose();
+		return (0);
+	}
+
+	if ((nKeys > 0) && (cellBits == 4))
+	{
+		printf("Multi-key: success probability over %d random keys.\n", nKeys);
+
+		if (falsePositive > 0.0)
+			testBudget = aes5Budget(cellBits, falsePositive, falseNegative, &achievedFP, &achievedFN);
+		if (nLanes == 0)
+			nLanes = ((int)std::thread::hardware_concurrency() > 0) ? (int)std::thread::hardware_concurrency() : 1;
+
+		result = multiKeyExperiment(nKeys, nLanes);
+
+		stopTelemetry();
+		resultClose();
+		return (result);
+	}
+
+	if ((fullKey == 1) && (cellBits == 4))
+	{
+		printf("Full key recovery: the four diagonals of the round-0 key.\n");
+
+		result = fullKeyRecovery(key, recoveredKey);
+
+		printf("Result:\n");
+		if (result == 0)
+		{
+			printf("\t Key found\n");
+			printtt(recoveredKey);
+		}
+		else
+			printf("\t Something Fail...\n\n");
+
+		stopTelemetry();
+		resultClose();
+		return (0);
+	}
+
 	printf("First step: AES\n");
 	printf("We check if it recognize an AES permutation and it print the right key.\n");
 	printf("Possible keys (row/column): 0/0 - 1/1 - 2/2 - 3/3\n");
 
-	result = distinguisher5Rounds(key, 0);
+	if ((nLanes > 0) && (cacheFile != NULL))
+	{
+		aes5SetKey(key);
+		if (aes5OpenCache(cacheFile, seed, cacheTestsWanted) != 0)
+		{
+			stopTelemetry();
+			resultClose();
+			return (1);
+		}
+	}
+
+	if (nLanes > 0)
+		result = distinguisher5RoundsPipeline(key, nLanes, first, last, seed, falsePositive, falseNegative);
+	else
+		result = distinguisher5Rounds(key, 0);
 
 	printf("Result:\n");
 	if (result == 0)
@@ -1117,8 +6178,12 @@ int main()
 	else
 		printf("\t Something Fail...\n\n");*/
 
-	system("pause");
+	stopTelemetry();
+	resultClose();
+	aes5CloseCache();
 
 	return (0);
 }
 
+#endif
+
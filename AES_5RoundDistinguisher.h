@@ -0,0 +1,94 @@
+/**DISTINGUISHER ON 5 ROUNDS - LIBRARY INTERFACE
+
+Compile AES_5RoundDistinguisher.cpp with -DAES5_LIBRARY to leave out main, and link it in the program that runs the experiments:
+the tables are built once by aes5Init and stay in memory between the runs.
+The engine has global state (tables, random generator, constants, result sink): only one run at a time, called from one thread
+(the run itself uses its own threads). The state and the internal functions are in the namespace aes5 of the library, and the names
+exported by this header all begin with aes5.
+
+Typical use:
+	aes5Init(NULL, seed);
+	aes5SetKey(key);
+	aes5Run(&config, ranges, nRanges, survivors, maxSurvivors, progress, context, &budget);
+*/
+
+#ifndef AES_5ROUND_DISTINGUISHER_H
+#define AES_5ROUND_DISTINGUISHER_H
+
+typedef unsigned char aes5Word8;//8 bits
+
+/*Encryption oracle: ciphertext (16 cells, position j + 4*i for the row j and the column i) of the plaintext (cells plaintext[row][column]).
+context is the pointer given to aes5SetOracle.
+The oracle must be thread-safe: aes5Run calls it at the same time from its config->nLanes generator threads (with the same context)*/
+typedef void (*aes5Oracle)(aes5Word8 plaintext[][4], aes5Word8 *ciphertext, void *context);
+
+/*Progress of a run, called about every 20 ms from the calling thread: a return value != 0 cancels the run
+(the candidates already started are completed, the next ranges are not started, and aes5Run returns AES5_CANCELLED)*/
+typedef int (*aes5Progress)(long long done, long long total, long long survivors, void *context);
+
+typedef struct{
+	int cellBits;/* 4 (small scale AES) or 8 (AES) */
+	int nLanes;/* pairs of generator/checker threads */
+	long int numberTests;/* tests for each candidate, at most N_TEST (0 = N_TEST) */
+	unsigned long seed;/* seed of the constants: the same seed gives the same sets of plaintexts in all the ranges */
+	double falsePositive;/* if > 0, the tests for each candidate are the adaptive budget for these rates (at most numberTests) */
+	double falseNegative;
+} aes5Config;
+
+typedef struct{
+	long long first, last;/* candidates in [first, last), k1 is the most significant cell */
+} aes5Range;
+
+/*Budget used by aes5Run*/
+typedef struct{
+	long int numberTests;/* tests for each candidate */
+	double falsePositive, falseNegative;/* rates achieved by the adaptive budget (-1 if config->falsePositive = 0) */
+} aes5RunBudget;
+
+/*S-box and MixColumns (spnFile, or the default ones if NULL) and random generator. It returns 0 if OK*/
+int aes5Init(const char *spnFile, unsigned long seed);
+
+/*Secret key of the encryption (used if there is no oracle)*/
+void aes5SetKey(aes5Word8 key[][4]);
+
+/*Encryption by an external oracle instead of the secret key (NULL to go back to the key): see aes5Oracle, it must be thread-safe*/
+void aes5SetOracle(aes5Oracle oracle, void *context);
+
+/*Decryption by an external oracle instead of the secret key, for the chosen-ciphertext distinguisher (NULL to go back to the key):
+the oracle has the same type, with the ciphertext as input (cells[row][column]) and the plaintext as output (position j + 4*i).
+It must be thread-safe as well: the sweep calls it at the same time from all its threads*/
+void aes5SetDecryptionOracle(aes5Oracle oracle, void *context);
+
+/*Ciphertext cache in fileName (see CIPHERTEXT CACHE): it is created, or extended to numberTests tests (0 = N_TEST), for the secret
+key and the constants of seed, and mapped in memory. The runs with the same key and seed read the ciphertexts of these tests from it.
+It returns 0 if OK*/
+int aes5OpenCache(const char *fileName, unsigned long seed, long int numberTests);
+void aes5CloseCache();
+
+/*Adaptive budget of tests for each candidate (see ADAPTIVE TEST BUDGET) for the rates falsePositive (wrong candidate that survives)
+and falseNegative (right candidate eliminated), at most N_TEST: the rates achieved are in achievedFP and achievedFN.
+For the small scale AES the probability of a collision of a wrong candidate is the Markov-model estimate for the S-box and the matrix
+(see TRUNCATED DIFFERENTIALS, computed at the first call). It returns -1 if no budget can separate the candidates*/
+long int aes5Budget(int cellBits, double falsePositive, double falseNegative, double *achievedFP, double *achievedFN);
+
+/*Tests of the distinguisher for nKeys (key, candidate) pairs (small scale AES), 64 at once in the lanes of the bitsliced encryption
+(see MULTI-KEY BITSLICED ENCRYPTION), on nThreads threads. candidates[l] is the diagonal of the round-0 key guessed for keys[l]
+(k1 in the most significant nibble); the constants of the numberTests tests (at most N_TEST) come from seed and are shared.
+eliminatedAt[l] = tests until the first collision (numberTests if the pair survives). It returns the number of survivors, or -1*/
+long long aes5MultiKeyRun(aes5Word8 keys[][4][4], int *candidates, int nKeys, long int numberTests, unsigned long seed, long int *eliminatedAt, int nThreads);
+
+#define AES5_INVALID -1
+#define AES5_CANCELLED -2
+
+/*Pipelined distinguisher on the ranges: the survivors (sorted in each range) are written in survivors[0 - maxSurvivors-1]; of each
+range, only the first 2^20 found are listed (all of them are in the result sink).
+It returns the number of survivors (also if > maxSurvivors), AES5_INVALID if the configuration is not valid, or AES5_CANCELLED if
+the progress callback cancelled the run (the range in progress is recorded in the result sink as cancelled).
+If budget is not NULL, it receives the tests for each candidate and the rates they achieve (also if the run is cancelled).
+With cellBits = 8 the configuration is not valid if the tests (numberTests, or N_TEST) cannot separate the candidates of the ranges:
+each wrong one must survive with probability at most falsePositive, or 1 / (candidates of the ranges) if falsePositive = 0 (about
+730000 tests for a whole sweep: the library must be compiled with a larger N_TEST)*/
+long long aes5Run(const aes5Config *config, const aes5Range *range, int nRanges, long long *survivors, long long maxSurvivors,
+	aes5Progress progress, void *context, aes5RunBudget *budget);
+
+#endif